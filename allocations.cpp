@@ -0,0 +1,30 @@
+// Counts the heap allocations for the stats, see heapAllocations. Only the
+// benchmark and, built with MIPS_COUNT_ALLOCATIONS, mips-assembler link this
+// file, the library leaves operator new alone.
+
+#include <cstdlib>
+#include <new>
+
+#include "stats.hpp"
+
+namespace {
+
+// tells the stats that heapAllocations is counted
+struct CountedAllocations {
+    CountedAllocations() { heapAllocationsCounted = true; }
+} counted_allocations;
+
+}  // namespace
+
+void *operator new(std::size_t size) {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
@@ -0,0 +1,1431 @@
+#include "assembler.hpp"
+
+#include "definitions.hpp"
+#include "directives.hpp"
+#include "lexer.hpp"
+#include "macros.hpp"
+#include "source.hpp"
+
+/**
+ * @brief Calls lexLine and adds its time to the stats.
+ */
+LineTokens lexLine(std::string_view line, AssemblerStats *stats) {
+    if (!stats) return lexLine(line);
+    StatsTimer timer(stats, STATS_LEXING);
+    return lexLine(line);
+}
+
+// --------------------------------------------------------
+
+// kinds of source lines for the macros and segments
+enum {
+    LINE_KIND_ORDINARY,    // label, comment or instruction
+    LINE_KIND_DEFINITION,  // part of a macro definition, takes no address
+    LINE_KIND_EXPANDED,    // pseudo-instruction or macro call
+    LINE_KIND_DATA         // directive or line of the data segment, takes no address
+};
+
+/**
+ * @brief Follows the macro definitions and expands pseudo-instructions and
+ * macro calls for the passes that only count the words. Errors are left to
+ * the passes that report them, an expansion with an error takes one word
+ * there.
+ *
+ * @param segment SEGMENT_* of the line
+ * @param words receives the number of words of an expanded line
+ * @return int LINE_KIND_*
+ */
+int countExpansion(MacroTable &macros,
+                   const LineTokens &tokens,
+                   std::string_view line,
+                   int segment,
+                   Expansion &expansion,
+                   size_t &words) {
+    int kind = LINE_KIND_DEFINITION;
+    words = 1;
+    try {
+        if (!macros.define(tokens, line)) {
+            kind = LINE_KIND_DATA;
+            if (segment == SEGMENT_TEXT && findDirective(tokens.mnemonic) < 0) {
+                kind = LINE_KIND_EXPANDED;
+                if (!macros.expand(tokens, line, expansion)) kind = LINE_KIND_ORDINARY;
+                words = expansion.instructions.size();
+            }
+        }
+    } catch (const AssemblerError &) {
+    }
+    return kind;
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Counts a line of the kind LINE_KIND_DATA and defines its label. A
+ * label on a line of the data segment without data waits in pending for the
+ * next data and takes its address after the alignment, as in other MIPS
+ * assemblers, so a label above ".word" is aligned with the words.
+ *
+ * @param segment SEGMENT_* of the line, receives the one of the next line
+ * @param data_address address in the data segment, moved behind the line
+ * @param addrPointer address of the next instruction, for a label in the
+ * text segment
+ * @param pending labels that wait for the next data
+ * @param incbinSizes receives the sizes of the files of ".incbin"
+ */
+void countDataLine(const LineTokens &tokens,
+                   std::string_view line,
+                   int &segment,
+                   uint32_t &data_address,
+                   unsigned int addrPointer,
+                   std::vector<std::string_view> &pending,
+                   SymbolTable &labelAddrMap,
+                   IncbinSizes &incbinSizes) {
+    int label_segment = segment;
+    uint32_t address = data_address;
+    uint32_t start = countData(tokens, line, segment, data_address, incbinSizes);
+    if (label_segment == SEGMENT_DATA && tokens.mnemonic.empty()) {
+        pending.push_back(tokens.labelName());
+        return;
+    }
+    bool has_data = label_segment == SEGMENT_DATA && findDirective(tokens.mnemonic) >= DIRECTIVE_WORD;
+    for (std::string_view name: pending) labelAddrMap.set(name, has_data ? start : address, SEGMENT_DATA);
+    pending.clear();
+    if (!tokens.label.empty()) {
+        labelAddrMap.set(tokens.labelName(), label_segment == SEGMENT_DATA ? start : addrPointer, label_segment);
+    }
+}
+
+// --------------------------------------------------------
+
+void firstPass(std::string_view source, SymbolTable &labelAddrMap, IncbinSizes &incbinSizes, AssemblerStats *stats) {
+    StatsTimer timer(stats, STATS_FIRST_PASS);
+    std::string_view currentLine;
+    size_t linePos = 0;
+    unsigned int addrPointer = 0;
+    int segment = SEGMENT_TEXT;
+    uint32_t data_address = 0;
+    std::vector<std::string_view> data_labels;  // see countDataLine
+    MacroTable macros;
+    Expansion expansion;
+
+    while (nextLine(source, linePos, currentLine)) {
+        // Looking for lines with codes
+        LineTokens tokens = lexLine(currentLine, stats);
+        if (!tokens.hasCode) continue;
+        size_t words;
+        int kind = countExpansion(macros, tokens, currentLine, segment, expansion, words);
+        if (kind == LINE_KIND_DEFINITION) continue;
+        if (kind == LINE_KIND_DATA) {
+            countDataLine(tokens, currentLine, segment, data_address, addrPointer, data_labels, labelAddrMap,
+                          incbinSizes);
+            continue;
+        }
+
+        if (!tokens.label.empty()) {
+            labelAddrMap.set(tokens.labelName(), addrPointer);
+        }
+        if (kind == LINE_KIND_EXPANDED) {
+            addrPointer += 4 * words;
+        } else if (!tokens.labelSingle) {
+            addrPointer += 4;
+        }
+    }
+    for (std::string_view name: data_labels) labelAddrMap.set(name, data_address, SEGMENT_DATA);
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Converts the number at the start of a string like stoi, characters
+ * after the number are ignored.
+ *
+ * @return int the number
+ * @throws AssemblerError if s doesn't start with a number that fits into an int
+ */
+int parseNumber(std::string_view s) {
+    long long value;
+    if (readNumber(s, value) == 0 || value < INT32_MIN || value > INT32_MAX) {
+        throw AssemblerError("Invalid number.", std::string(s));
+    }
+    return static_cast<int>(value);
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Converts a register abbreviation into the numerical index of the
+ * corresponding register.
+ *
+ * @param s String that contains the register abbreviation. Must begin with '$'
+ * followed by either the numeric index or the alphanumerical abbreviation. E.g.
+ * "$14" or "$t1".
+ * @return uint8_t the numerical index of the corresponding register.
+ * @throws AssemblerError if the register is invalid
+ */
+uint8_t regCode(std::string_view s) {
+    // accepted forms: "$zero", two digits, a letter followed by a digit or two
+    // letters
+    auto is_digit = [](char c) { return c >= '0' && c <= '9'; };
+    auto is_lower = [](char c) { return c >= 'a' && c <= 'z'; };
+    bool valid = s == "$zero" || (s.length() == 3 && s[0] == '$' &&
+                                  ((is_digit(s[1]) && is_digit(s[2])) ||
+                                   (is_lower(s[1]) && (is_digit(s[2]) || is_lower(s[2])))));
+    if (!valid) {
+        throw AssemblerError(std::string("Register string invalid: ") + std::string(s) + ".", std::string(s));
+    }
+
+    if (is_digit(s[1])) {  // there is a number after $ -> no abbreviations
+        int register_number = (s[1] - '0') * 10 + (s[2] - '0');
+        if (register_number > 31) {
+            throw AssemblerError(std::string("Register out of range: ") + std::to_string(register_number) + ".", std::string(s));
+        }
+        return static_cast<uint8_t>(register_number);
+    }
+
+    // register abbreviations
+    const int result = findRegister(s);
+    if (result < 0) {
+        throw AssemblerError(std::string("Register abbreviation not supported: ") + std::string(s) + ".", std::string(s));
+    }
+
+    return static_cast<uint8_t>(result);
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Splits the tokens of a line into the parts of its instruction in
+ * the order {instr, rt, rs, imm}, so the base register of "offset(base)" comes
+ * before the offset. Other operands keep their order.
+ *
+ * @param tokens tokens of the line
+ * @param parts receives the parts, views into the line
+ * @return size_t number of parts, 0 if the line has no instruction
+ */
+size_t instructionParts(const LineTokens &tokens, std::string_view parts[4]) {
+    const std::string_view *operands = tokens.operands;
+    parts[0] = tokens.mnemonic;
+
+    switch (tokens.shape) {
+        case LINE_SHAPE_ONE:
+            return 1;
+        case LINE_SHAPE_TWO:
+            parts[1] = operands[0];
+            return 2;
+        case LINE_SHAPE_OFFSET:
+            parts[1] = operands[0];
+            parts[2] = operands[2];
+            parts[3] = operands[1];
+            return 4;
+        case LINE_SHAPE_PAIR:
+            parts[1] = operands[0];
+            parts[2] = operands[1];
+            return 3;
+        case LINE_SHAPE_THREE:
+            parts[1] = operands[0];
+            parts[2] = operands[1];
+            parts[3] = operands[2];
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Tells whether a line takes a word in the instructions. Lines that
+ * match no layout are errors, unless they start with a label, then they are
+ * ignored.
+ */
+bool isInstruction(const LineTokens &tokens) {
+    return tokens.shape != LINE_SHAPE_NONE && (tokens.shape != LINE_SHAPE_INVALID || tokens.label.empty());
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief outputPrinting writes the line of the listing for a source line
+ *
+ * @param outputListing output buffer for the file containing the listing
+ * @param tokens tokens of the source line
+ * @param instruction the parsed instruction of the line, nullptr if the line
+ * has none
+ * @param binary_instruction the encoded instruction
+ * @param instruction_count contain the current instruction address
+ */
+void outputPrinting(OutputBuffer &outputListing,
+                    const LineTokens &tokens,
+                    const Instruction *instruction,
+                    uint32_t binary_instruction,
+                    int instruction_count) {
+    if (instruction == nullptr) {
+        if (!tokens.label.empty() || !tokens.comment.empty()) {
+            outputListing << "                            ";
+        }
+        if (!tokens.label.empty()) {
+            outputListing << tokens.label;
+        }
+        if (!tokens.comment.empty()) {
+            if (!tokens.label.empty()) {
+                outputListing << "    ";
+            }
+            outputListing << tokens.comment;
+        }
+        outputListing << "\n";
+        return;
+    }
+
+    outputListing << "0x";
+    outputListing.appendHex(instruction_count);
+    outputListing << "    0x";
+    outputListing.appendHex(binary_instruction);
+    if (tokens.label.empty()) {
+        outputListing << "                  ";
+    } else {
+        outputListing << "    ";
+        outputListing.appendPadded(tokens.label, 10);
+        outputListing << "    ";
+    }
+
+    std::string_view parts[4];
+    size_t part_cnt = instructionParts(tokens, parts);
+    int syntax = INSTR_CODES[instruction->opcode].syntax;
+    bool number_target = instruction->label == NO_LABEL && takesLabel(instruction->opcode) &&
+                         tokens.shape != LINE_SHAPE_OFFSET;
+    if (syntax == SYNTAX_RT_OFFSET_BASE) {
+        outputListing << parts[0] << " " << parts[1] << " " << parts[3] << "(" << parts[2] << ") ";
+    } else if (number_target) {
+        // the target is printed as converted, "beq rs, rt" with swapped registers
+        outputListing << parts[0] << " ";
+        if (syntax == SYNTAX_RS_RT_LABEL) outputListing << parts[2] << " " << parts[1] << " ";
+        if (syntax == SYNTAX_RS_LABEL) outputListing << parts[1] << " ";
+        outputListing << instruction->immediate << " ";
+    } else {
+        for (size_t i = 0; i < part_cnt; ++i) outputListing << parts[i] << " ";
+    }
+    if (!tokens.comment.empty()) {
+        outputListing << "    ";
+        outputListing << tokens.comment;
+    }
+    outputListing << "\n";
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief symbolsOutputPrinting print the symbols at the ends of the listing
+ * file when the outputPrinting function has finished
+ *
+ * @param outputListing output buffer for the file containing the listing
+ * @param labelAddrMap reference to a map that holds the numerical addresses for
+ * each label
+ */
+void symbolsOutputPrinting(OutputBuffer &outputListing, const SymbolTable &labelAddrMap) {
+    outputListing << "\nSymbols\n";
+    for (const auto &lbl: labelAddrMap.sorted()) {
+        outputListing.appendPadded(lbl.name, 13);
+        outputListing << " 0x";
+        outputListing.appendHex(lbl.address);
+        if (lbl.segment == SEGMENT_DATA) outputListing << " data";
+        outputListing << "\n";
+    }
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Writes the line of the listing for a source line without an
+ * instruction, a macro definition, a pseudo-instruction whose expansion
+ * follows or a line of the data segment.
+ *
+ * @param address address of the data of the line, -1 if it has none
+ */
+void sourcePrinting(OutputBuffer &outputListing, const LineTokens &tokens, std::string_view line, int address = -1) {
+    if (address < 0) {
+        outputListing << "                        ";
+    } else {
+        outputListing << "0x";
+        outputListing.appendHex(address);
+        outputListing << "              ";
+    }
+    if (tokens.label.empty()) {
+        outputListing << "                  ";
+    } else {
+        outputListing << "    ";
+        outputListing.appendPadded(tokens.label, 10);
+        outputListing << "    ";
+    }
+    if (!tokens.mnemonic.empty()) outputListing << tokens.mnemonic << " ";
+    std::string_view operands = operandText(tokens, line);
+    if (!operands.empty()) outputListing << operands << " ";
+    if (!tokens.comment.empty()) {
+        outputListing << "    ";
+        outputListing << tokens.comment;
+    }
+    outputListing << "\n";
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Writes the line of the listing for an instruction of an expansion,
+ * indented below its source line.
+ */
+void expansionPrinting(OutputBuffer &outputListing,
+                       const ExpandedInstruction &expanded,
+                       const Instruction &instruction,
+                       uint32_t binary_instruction,
+                       int instruction_count) {
+    outputListing << "0x";
+    outputListing.appendHex(instruction_count);
+    outputListing << "    0x";
+    outputListing.appendHex(binary_instruction);
+    outputListing << "                      ";
+
+    const std::string_view *parts = expanded.parts;
+    outputListing << parts[0] << " ";
+    if (INSTR_CODES[instruction.opcode].syntax == SYNTAX_RT_OFFSET_BASE && expanded.partCount == 4) {
+        outputListing << parts[1] << " " << parts[3] << "(" << parts[2] << ") ";
+    } else {
+        for (size_t i = 1; i < expanded.partCount; ++i) {
+            bool half = i + 1 == expanded.partCount && (expanded.syntax == SYNTAX_RT_HI || expanded.syntax == SYNTAX_RT_RS_LO);
+            if (half) outputListing << (expanded.syntax == SYNTAX_RT_HI ? "%hi(" : "%lo(");
+            outputListing << parts[i] << (half ? ") " : " ");
+        }
+    }
+    outputListing << "\n";
+}
+
+// --------------------------------------------------------
+
+void checkImmediate(const Instruction &instruction, std::string_view token) {
+    switch (INSTR_CODES[instruction.opcode].codes.format) {
+        case INSTR_TYPE_R:
+            if (instruction.immediate < 0 || instruction.immediate > 31) {
+                throw AssemblerError("Shift amount out of range.", std::string(token));
+            }
+            break;
+        case INSTR_TYPE_I:
+            if (instruction.immediate > 0xFFFF) throw AssemblerError("Argument too long.", std::string(token));
+            break;
+        case INSTR_TYPE_J:
+            if (instruction.immediate > 0x3FFFFFF) throw AssemblerError("Jump address too long.", std::string(token));
+            break;
+    }
+}
+
+// --------------------------------------------------------
+
+int symbolTarget(int opcode, const SymbolTable::Symbol &symbol, int instruction_count) {
+    if (symbol.segment == SEGMENT_DATA && opcode != INSTR_LUI && opcode != INSTR_ORI) {
+        throw AssemblerError(std::string("label '") + std::string(symbol.name) + "' is in the data segment!",
+                             std::string(symbol.name));
+    }
+    return labelTarget(opcode, symbol.address, instruction_count);
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Name of a layout in the errors.
+ */
+const char *formatName(int format) {
+    switch (format) {
+        case INSTR_TYPE_R:
+            return "R";
+        case INSTR_TYPE_I:
+            return "I";
+        default:
+            return "J";
+    }
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Parses a jump target, branch offset or address half that is a
+ * number or a label.
+ *
+ * @param token the operand
+ * @param opcode INSTR_* of the instruction
+ * @param instruction receives the target, offset or half as immediate, 0 for
+ * a label that is not defined, and the index of the label in labelCalls
+ * @return true, if token is a label that is not in labelAddrMap
+ * @throws AssemblerError if the number is invalid or too long, or if the label
+ * is not defined and allowUndefined is false
+ */
+bool parseTarget(std::string_view token,
+                 int opcode,
+                 const SymbolTable &labelAddrMap,
+                 int instruction_count,
+                 Instruction &instruction,
+                 std::vector<std::string_view> &labelCalls,
+                 bool allowUndefined) {
+    long long value;
+    bool is_integer = readNumber(token, value) == token.size();
+    bool address_half = opcode == INSTR_LUI || opcode == INSTR_ORI;
+    if (INSTR_CODES[opcode].codes.format == INSTR_TYPE_I && !address_half && value > 0xFFFF) {
+        throw AssemblerError("Argument too long.", std::string(token));
+    }
+
+    if (is_integer) {
+        if (value < INT32_MIN || value > (address_half ? UINT32_MAX : INT32_MAX)) {
+            throw AssemblerError("Invalid number.", std::string(token));
+        }
+        // a number in place of a label is taken as it is, or as an address
+        instruction.immediate = address_half ? labelTarget(opcode, static_cast<int>(static_cast<uint32_t>(value)), 0)
+                                             : static_cast<int>(value);
+        return false;
+    }
+
+    // input is a label
+    bool undefined = false;
+    instruction.immediate = 0;
+    if (const SymbolTable::Symbol *symbol = labelAddrMap.findSymbol(token)) {
+        instruction.immediate = symbolTarget(opcode, *symbol, instruction_count);
+    } else if (allowUndefined) {
+        undefined = true;
+    } else {
+        throw AssemblerError(std::string("label '") + std::string(token) + "' does not exist!", std::string(token));
+    }
+    instruction.label = static_cast<uint32_t>(labelCalls.size());
+    labelCalls.push_back(token);
+    return undefined;
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Matches "%hi(label)" or "%lo(label)".
+ *
+ * @param half "%hi" or "%lo"
+ * @param label receives the label
+ */
+bool matchLabelHalf(std::string_view s, std::string_view half, std::string_view &label) {
+    if (s.size() < half.size() + 3 || s.substr(0, half.size()) != half || s[half.size()] != '(' || s.back() != ')') {
+        return false;
+    }
+    label = s.substr(half.size() + 1, s.size() - half.size() - 2);
+    return true;
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Parses the parts of an instruction and resolves the label of a jump,
+ * a branch or a half of an address. The operands are taken as described by
+ * the syntax of the instruction in INSTR_CODES.
+ *
+ * @param parts the instruction as ordered by instructionParts
+ * @param part_cnt number of parts
+ * @param syntax_override SYNTAX_* that replaces the one of the instruction,
+ * -1 for none
+ * @param labelAddrMap reference to a map that holds the numerical addresses for
+ * each known label
+ * @param instruction_count address of the current instruction
+ * @param instruction receives the parsed instruction, its line is kept
+ * @param labelCalls receives the name of the referenced label, if there is
+ * one. The label of instruction is its index.
+ * @param allowUndefined if true, a label that is not in labelAddrMap (yet) is
+ * encoded as 0 instead of being an error
+ * @return true, if the instruction refers to a label that is not in
+ * labelAddrMap
+ * @throws AssemblerError if the instruction is not supported or its arguments
+ * are invalid
+ */
+bool parseParts(const std::string_view *parts,
+                size_t part_cnt,
+                int syntax_override,
+                const SymbolTable &labelAddrMap,
+                int instruction_count,
+                Instruction &instruction,
+                std::vector<std::string_view> &labelCalls,
+                bool allowUndefined) {
+    // find codes and syntax for instruction
+    int opcode = findInstruction(parts[0]);
+    if (opcode < 0) {
+        throw AssemblerError(std::string("Instruction ") + std::string(parts[0]) + " is not supported.", std::string(parts[0]));
+    }
+    instruction.opcode = static_cast<uint8_t>(opcode);
+    uint32_t format = INSTR_CODES[opcode].codes.format;
+    int syntax_index = syntax_override >= 0 ? syntax_override : INSTR_CODES[opcode].syntax;
+    if (syntax_override < 0 && part_cnt == 2 && syntax_index == SYNTAX_RD_RS_RT) {
+        syntax_index = SYNTAX_RS;  // taken like "jr rs"
+    }
+
+    // "lui rt, %hi(label)" and "ori rt, rs, %lo(label)"
+    std::string_view label_parts[4];
+    if (syntax_override < 0 && part_cnt >= 3) {
+        std::string_view label;
+        if ((opcode == INSTR_LUI && part_cnt == 3 && matchLabelHalf(parts[2], "%hi", label)) ||
+            (opcode == INSTR_ORI && part_cnt == 4 && matchLabelHalf(parts[3], "%lo", label))) {
+            std::copy(parts, parts + part_cnt, label_parts);
+            label_parts[part_cnt - 1] = label;
+            parts = label_parts;
+            syntax_index = opcode == INSTR_LUI ? SYNTAX_RT_HI : SYNTAX_RT_RS_LO;
+        }
+    }
+
+    const OperandSyntax &syntax = INSTR_SYNTAX[syntax_index];
+    if (syntax.partCount != 1 && syntax.partCount != part_cnt) {
+        throw AssemblerError(std::string("Wrong amount of arguments for instruction type ") + formatName(format) + ": " +
+                             std::to_string(part_cnt) + ".");
+    }
+
+    bool undefined = false;
+    for (int i = 0; i < syntax.operandCount; ++i) {
+        std::string_view part = parts[syntax.operands[i].part];
+        switch (syntax.operands[i].field) {
+            case FIELD_RD:
+                instruction.rd = regCode(part);
+                break;
+            case FIELD_RS:
+                instruction.rs = regCode(part);
+                break;
+            case FIELD_RT:
+                instruction.rt = regCode(part);
+                break;
+            case FIELD_IMMEDIATE:
+                instruction.immediate = parseNumber(part);
+                checkImmediate(instruction, part);
+                break;
+            case FIELD_LABEL:
+                undefined = parseTarget(part, opcode, labelAddrMap, instruction_count, instruction, labelCalls, allowUndefined);
+                checkImmediate(instruction, part);
+                break;
+        }
+    }
+    if (syntax.fixedRd != 0) instruction.rd = syntax.fixedRd;
+    return undefined;
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Parses the instruction of a line, see parseParts. The line must have
+ * an instruction, see isInstruction.
+ *
+ * @param tokens tokens of the current line
+ * @throws AssemblerError if the instruction is not supported or its arguments
+ * are invalid
+ */
+bool parseInstruction(const LineTokens &tokens,
+                      const SymbolTable &labelAddrMap,
+                      int instruction_count,
+                      Instruction &instruction,
+                      std::vector<std::string_view> &labelCalls,
+                      bool allowUndefined) {
+    if (tokens.shape == LINE_SHAPE_INVALID) {
+        throw AssemblerError("Wrong amount of arguments, operation not supported.");
+    }
+    std::string_view parts[4];
+    size_t part_cnt = instructionParts(tokens, parts);
+    return parseParts(parts, part_cnt, -1, labelAddrMap, instruction_count, instruction, labelCalls, allowUndefined);
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Column of an error in a source line.
+ *
+ * @param line the source line
+ * @param tokens tokens of the line
+ * @param token part of the line that caused the error, may be empty
+ * @return size_t 1-based column of token, or of the mnemonic if token is
+ * empty or can't be found
+ */
+size_t errorColumn(std::string_view line, const LineTokens &tokens, std::string_view token) {
+    std::string_view code = line.substr(0, line.find('#'));
+    size_t pos = token.empty() ? std::string_view::npos : code.find(token);
+    if (pos == std::string_view::npos && !tokens.mnemonic.empty()) {
+        pos = tokens.mnemonic.data() - line.data();
+    }
+    if (pos == std::string_view::npos) pos = code.find_first_not_of(" \t");
+    return pos == std::string_view::npos ? 1 : pos + 1;
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Records an error of a source line and writes it into the listing in
+ * place of the line. Nops take the place of the instructions, so the
+ * addresses of the following instructions stay the same as computed by the
+ * first pass.
+ *
+ * @param diagnostics receives the error
+ * @param line_number 1-based number of the line
+ * @param line the source line
+ * @param tokens tokens of the line
+ * @param error the error
+ * @param outputListing output buffer for the listing, nullptr if no listing
+ * is generated
+ * @param instructions receives the placeholder instructions
+ * @param instruction_count address of the current instruction
+ * @param words number of instructions the line takes
+ */
+void reportLineError(Diagnostics &diagnostics,
+                     size_t line_number,
+                     std::string_view line,
+                     const LineTokens &tokens,
+                     const AssemblerError &error,
+                     OutputBuffer *outputListing,
+                     std::vector<Instruction> &instructions,
+                     int &instruction_count,
+                     size_t words = 1) {
+    diagnostics.report(line_number, errorColumn(line, tokens, error.token()), SEVERITY_ERROR, error.what());
+    if (outputListing) *outputListing << "Error: " << error.what() << "\n";
+    Instruction placeholder;
+    placeholder.line = static_cast<uint32_t>(line_number);
+    instructions.insert(instructions.end(), words, placeholder);
+    instruction_count += static_cast<int>(4 * words);
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief An instruction of onePass that refers to a label. It is patched
+ * after the pass if the label was not defined yet when the instruction was
+ * encoded, or if a label was defined again later, so all references take
+ * the last definition like in secondPass.
+ */
+struct LabelFixup {
+    size_t index;  // index of the instruction
+    int instruction_count;
+    size_t listingPos;  // offset of the hex word in the listing
+    size_t column;      // position of the label in the source line
+    bool defined;       // the label was defined when the instruction was encoded
+};
+
+/**
+ * @brief Parses the instructions of an expanded line and writes them into
+ * the listing below the line. If one has an error, the line is reported like
+ * an instruction with an error.
+ *
+ * @param expansion the instructions of the line
+ * @param allowUndefined if true, a label that is not defined (yet) is encoded
+ * as 0 instead of being an error
+ * @param fixups receives the instructions that refer to a label, nullptr if
+ * they are not needed
+ * @see secondPassLines for the other parameters
+ */
+void assembleExpansion(const Expansion &expansion,
+                       const LineTokens &tokens,
+                       std::string_view line,
+                       size_t line_number,
+                       const SymbolTable &labelAddrMap,
+                       OutputBuffer *outputListing,
+                       std::vector<Instruction> &instructions,
+                       std::vector<std::string_view> &labelCalls,
+                       bool allowUndefined,
+                       std::vector<LabelFixup> *fixups,
+                       Diagnostics &diagnostics,
+                       int &instruction_count,
+                       AssemblerStats *stats) {
+    size_t first = instructions.size();
+    size_t first_label_call = labelCalls.size();
+    size_t first_fixup = fixups ? fixups->size() : 0;
+    int count = instruction_count;
+    try {
+        for (const ExpandedInstruction &expanded: expansion.instructions) {
+            Instruction instruction;
+            instruction.line = static_cast<uint32_t>(line_number);
+            bool undefined = parseParts(expanded.parts, expanded.partCount, expanded.syntax, labelAddrMap, count,
+                                        instruction, labelCalls, allowUndefined);
+            if (fixups && instruction.label != NO_LABEL) {
+                fixups->push_back({instructions.size(), count, 0,
+                                   errorColumn(line, tokens, labelCalls[instruction.label]), !undefined});
+            }
+            instructions.push_back(instruction);
+            count += 4;
+        }
+    } catch (const AssemblerError &e) {
+        instructions.resize(first);
+        labelCalls.resize(first_label_call);
+        if (fixups) fixups->resize(first_fixup);
+        reportLineError(diagnostics, line_number, line, tokens, e, outputListing, instructions, instruction_count,
+                        expansion.instructions.size());
+        return;
+    }
+
+    if (outputListing) {
+        StatsTimer listing_timer(stats, STATS_LISTING);
+        sourcePrinting(*outputListing, tokens, line);
+        size_t fixup = first_fixup;
+        for (size_t i = 0; i < expansion.instructions.size(); ++i) {
+            if (fixups && fixup < fixups->size() && (*fixups)[fixup].index == first + i) {
+                (*fixups)[fixup++].listingPos = outputListing->size() + 16;
+            }
+            const Instruction &instruction = instructions[first + i];
+            expansionPrinting(*outputListing, expansion.instructions[i], instruction, encodeInstruction(instruction),
+                              instruction_count + static_cast<int>(4 * i));
+        }
+    }
+    instruction_count = count;
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Assembles a line of the kind LINE_KIND_DATA into the data segment
+ * and writes it into the listing. An error is reported like for an
+ * instruction that takes no words.
+ *
+ * @param segment SEGMENT_* of the line, receives the one of the next line
+ * @see secondPassLines for the other parameters
+ */
+void assembleDataLine(const LineTokens &tokens,
+                      std::string_view line,
+                      size_t line_number,
+                      int &segment,
+                      OutputBuffer *outputListing,
+                      std::vector<Instruction> &instructions,
+                      std::vector<uint8_t> &data,
+                      IncbinSizes &incbinSizes,
+                      Diagnostics &diagnostics,
+                      int &instruction_count,
+                      AssemblerStats *stats) {
+    uint32_t address;
+    try {
+        address = assembleData(tokens, line, segment, data, incbinSizes);
+    } catch (const AssemblerError &e) {
+        reportLineError(diagnostics, line_number, line, tokens, e, outputListing, instructions, instruction_count, 0);
+        return;
+    }
+    if (outputListing) {
+        // a label without data gets its address from the next data, see countDataLine
+        StatsTimer listing_timer(stats, STATS_LISTING);
+        bool has_data = findDirective(tokens.mnemonic) >= DIRECTIVE_WORD;
+        sourcePrinting(*outputListing, tokens, line, has_data ? static_cast<int>(address) : -1);
+    }
+}
+
+// --------------------------------------------------------
+
+void secondPassLines(std::string_view text,
+                     size_t first_line,
+                     int instruction_count,
+                     OutputBuffer *outputListing,
+                     std::vector<Instruction> &instructions,
+                     std::vector<uint8_t> &data,
+                     IncbinSizes &incbinSizes,
+                     std::vector<std::string_view> &labelCalls,
+                     const SymbolTable &labelAddrMap,
+                     bool allowUndefined,
+                     Diagnostics &diagnostics,
+                     AssemblerStats *stats) {
+    StatsTimer timer(stats, STATS_SECOND_PASS);
+    std::string_view currentLine;
+    size_t linePos = 0;
+    size_t line_number = first_line;
+    size_t first_label_call = labelCalls.size();
+    int segment = SEGMENT_TEXT;
+    MacroTable macros;
+    Expansion expansion;
+
+    for (; !diagnostics.limitReached() && nextLine(text, linePos, currentLine); ++line_number) {
+        LineTokens tokens = lexLine(currentLine, stats);
+        if (stats && !tokens.comment.empty()) ++stats->comments;
+        int kind = LINE_KIND_ORDINARY;
+        if (tokens.hasCode) {
+            kind = LINE_KIND_DEFINITION;
+            try {
+                if (!macros.define(tokens, currentLine)) {
+                    kind = LINE_KIND_DATA;
+                    if (segment == SEGMENT_TEXT && findDirective(tokens.mnemonic) < 0) {
+                        kind = LINE_KIND_EXPANDED;
+                        if (!macros.expand(tokens, currentLine, expansion)) kind = LINE_KIND_ORDINARY;
+                    }
+                }
+            } catch (const AssemblerError &e) {
+                reportLineError(diagnostics, line_number, currentLine, tokens, e, outputListing, instructions,
+                                instruction_count, kind == LINE_KIND_DEFINITION ? 0 : 1);
+                continue;
+            }
+        }
+        if (kind == LINE_KIND_DEFINITION) {
+            if (outputListing) {
+                StatsTimer listing_timer(stats, STATS_LISTING);
+                sourcePrinting(*outputListing, tokens, currentLine);
+            }
+            continue;
+        }
+        if (kind == LINE_KIND_DATA) {
+            assembleDataLine(tokens, currentLine, line_number, segment, outputListing, instructions, data, incbinSizes,
+                             diagnostics, instruction_count, stats);
+            continue;
+        }
+        if (kind == LINE_KIND_EXPANDED) {
+            assembleExpansion(expansion, tokens, currentLine, line_number, labelAddrMap, outputListing, instructions,
+                              labelCalls, allowUndefined, nullptr, diagnostics, instruction_count, stats);
+            continue;
+        }
+        if (!isInstruction(tokens)) {
+            if (outputListing) {
+                StatsTimer listing_timer(stats, STATS_LISTING);
+                outputPrinting(*outputListing, tokens, nullptr, 0, instruction_count);
+            }
+            continue;
+        }
+
+        Instruction instruction;
+        instruction.line = static_cast<uint32_t>(line_number);
+        try {
+            parseInstruction(tokens, labelAddrMap, instruction_count, instruction, labelCalls, allowUndefined);
+        } catch (const AssemblerError &e) {
+            reportLineError(diagnostics, line_number, currentLine, tokens, e, outputListing, instructions, instruction_count);
+            continue;
+        }
+        if (outputListing) {
+            StatsTimer listing_timer(stats, STATS_LISTING);
+            outputPrinting(*outputListing, tokens, &instruction, encodeInstruction(instruction), instruction_count);
+        }
+        instructions.push_back(instruction);
+        instruction_count += 4;
+    }
+
+    if (stats) {
+        stats->lines += line_number - first_line;
+        stats->labelResolutions += labelCalls.size() - first_label_call;
+    }
+}
+
+// --------------------------------------------------------
+
+void secondPass(std::string_view source,
+                OutputBuffer *outputListing,
+                std::vector<uint32_t> &outputInstructions,
+                std::vector<uint8_t> &outputData,
+                IncbinSizes &incbinSizes,
+                SymbolTable &labelAddrMap,
+                Diagnostics &diagnostics,
+                AssemblerStats *stats) {
+    std::vector<Instruction> instructions;
+    std::vector<std::string_view> labelCalls;
+    secondPassLines(source, 1, 0, outputListing, instructions, outputData, incbinSizes, labelCalls, labelAddrMap, false,
+                    diagnostics, stats);
+    {
+        StatsTimer timer(stats, STATS_ENCODING);
+        encodeInstructions(instructions, outputInstructions);
+    }
+    if (outputListing && !diagnostics.limitReached()) {
+        StatsTimer timer(stats, STATS_LISTING);
+        symbolsOutputPrinting(*outputListing, labelAddrMap);
+    }
+}
+
+// --------------------------------------------------------
+
+// smallest part of the source that is worth its own thread
+constexpr size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+/**
+ * @brief Part of the source that is assembled by its own thread.
+ */
+struct SourceChunk {
+    std::string_view text;  // whole lines
+
+    // first pass
+    std::vector<std::pair<std::string_view, unsigned int>> labels;  // in order
+    unsigned int addrSize = 0;  // bytes counted for labels, see firstPass
+    int instructionSize = 0;    // bytes counted for instructions, see secondPass
+    size_t lineCount = 0;
+    AssemblerStats firstStats;
+
+    // second pass
+    std::string listing;  // formatted by an OutputBuffer, see OutputBuffer(std::string &)
+    std::vector<Instruction> instructions;
+    std::vector<uint8_t> data;  // stays empty, see parallelPasses
+    IncbinSizes incbinSizes;    // likewise
+    std::vector<std::string_view> labelCalls;
+    std::vector<uint32_t> words;
+    Diagnostics diagnostics;
+    AssemblerStats secondStats;
+};
+
+/**
+ * @brief Splits the source at line breaks into at most count parts of about
+ * the same size.
+ */
+std::vector<SourceChunk> splitSource(std::string_view source, size_t count) {
+    std::vector<SourceChunk> chunks(count);
+    size_t begin = 0;
+    for (size_t i = 0; i < count; ++i) {
+        size_t end = (i + 1 == count) ? source.size() : source.size() / count * (i + 1);
+        if (end < begin) end = begin;
+        end = source.find('\n', end);
+        end = (end == std::string_view::npos) ? source.size() : end + 1;
+        chunks[i].text = source.substr(begin, end - begin);
+        begin = end;
+    }
+    return chunks;
+}
+
+void parallelPasses(std::string_view source,
+                    OutputBuffer *outputListing,
+                    std::vector<uint32_t> &outputInstructions,
+                    std::vector<uint8_t> &outputData,
+                    SymbolTable &labelAddrMap,
+                    Diagnostics &diagnostics,
+                    unsigned jobs,
+                    AssemblerStats *stats) {
+    if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunk_cnt = std::min<size_t>(jobs, source.size() / MIN_CHUNK_SIZE);
+    // a macro is known from its definition on and the segment from the last
+    // ".data", which a chunk can't see
+    if (chunk_cnt <= 1 || source.find(".macro") != std::string_view::npos ||
+        source.find(".data") != std::string_view::npos) {
+        IncbinSizes incbinSizes(diagnostics.file());
+        firstPass(source, labelAddrMap, incbinSizes, stats);
+        secondPass(source, outputListing, outputInstructions, outputData, incbinSizes, labelAddrMap, diagnostics, stats);
+        return;
+    }
+    std::vector<SourceChunk> chunks = splitSource(source, chunk_cnt);
+
+    runParallel(chunk_cnt, jobs, [&](size_t i) {
+        SourceChunk &chunk = chunks[i];
+        AssemblerStats *chunk_stats = stats ? &chunk.firstStats : nullptr;
+        StatsTimer timer(chunk_stats, STATS_FIRST_PASS);
+        std::string_view currentLine;
+        size_t linePos = 0;
+        MacroTable macros;  // for the pseudo-instructions, there are no macros
+        Expansion expansion;
+        while (nextLine(chunk.text, linePos, currentLine)) {
+            ++chunk.lineCount;
+            LineTokens tokens = lexLine(currentLine, chunk_stats);
+            if (!tokens.hasCode) continue;
+            size_t words;
+            int kind = countExpansion(macros, tokens, currentLine, SEGMENT_TEXT, expansion, words);
+            if (kind == LINE_KIND_DEFINITION) continue;
+
+            if (!tokens.label.empty()) chunk.labels.emplace_back(tokens.labelName(), chunk.addrSize);
+            if (kind == LINE_KIND_DATA) continue;  // ".text" or an error
+            if (kind == LINE_KIND_EXPANDED) {
+                chunk.addrSize += 4 * words;
+                chunk.instructionSize += static_cast<int>(4 * words);
+                continue;
+            }
+            if (!tokens.labelSingle) chunk.addrSize += 4;
+            if (isInstruction(tokens)) chunk.instructionSize += 4;
+        }
+    });
+
+    // later definitions of a label replace earlier ones like in firstPass
+    unsigned int addrPointer = 0;
+    std::vector<int> chunk_address(chunk_cnt);
+    std::vector<size_t> chunk_line(chunk_cnt);
+    int instruction_count = 0;
+    size_t line_number = 1;
+    for (size_t i = 0; i < chunk_cnt; ++i) {
+        for (const auto &label: chunks[i].labels) {
+            labelAddrMap.set(label.first, addrPointer + label.second);
+        }
+        addrPointer += chunks[i].addrSize;
+        chunk_address[i] = instruction_count;
+        instruction_count += chunks[i].instructionSize;
+        chunk_line[i] = line_number;
+        line_number += chunks[i].lineCount;
+    }
+
+    auto encode_chunk = [&](size_t i, size_t error_limit) {
+        SourceChunk &chunk = chunks[i];
+        chunk.instructions.clear();
+        chunk.data.clear();
+        chunk.labelCalls.clear();
+        chunk.words.clear();
+        chunk.diagnostics = Diagnostics(diagnostics.file(), error_limit);
+        chunk.secondStats = AssemblerStats();
+        AssemblerStats *chunk_stats = stats ? &chunk.secondStats : nullptr;
+        OutputBuffer listing(chunk.listing);
+        secondPassLines(chunk.text,
+                        chunk_line[i],
+                        chunk_address[i],
+                        outputListing ? &listing : nullptr,
+                        chunk.instructions,
+                        chunk.data,
+                        chunk.incbinSizes,
+                        chunk.labelCalls,
+                        labelAddrMap,
+                        false,
+                        chunk.diagnostics,
+                        chunk_stats);
+        StatsTimer timer(chunk_stats, STATS_ENCODING);
+        encodeInstructions(chunk.instructions, chunk.words);
+    };
+    runParallel(chunk_cnt, jobs, [&](size_t i) { encode_chunk(i, diagnostics.errorLimit()); });
+
+    // stitch the outputs, reaching the error limit stops like in secondPass
+    for (size_t i = 0; i < chunk_cnt && !diagnostics.limitReached(); ++i) {
+        SourceChunk &chunk = chunks[i];
+        size_t errors_left = diagnostics.errorLimit() - diagnostics.errorCount();
+        if (diagnostics.errorLimit() != 0 && chunk.diagnostics.errorCount() >= errors_left) {
+            encode_chunk(i, errors_left);
+        }
+        if (outputListing) *outputListing << chunk.listing;
+        outputInstructions.insert(outputInstructions.end(), chunk.words.begin(), chunk.words.end());
+        diagnostics.append(chunk.diagnostics);
+        if (stats) {
+            stats->add(chunk.firstStats);
+            stats->add(chunk.secondStats);
+        }
+    }
+    if (outputListing && !diagnostics.limitReached()) {
+        StatsTimer timer(stats, STATS_LISTING);
+        symbolsOutputPrinting(*outputListing, labelAddrMap);
+    }
+}
+
+// --------------------------------------------------------
+
+void onePass(std::string_view source,
+             OutputBuffer *outputListing,
+             std::vector<uint32_t> &outputInstructions,
+             std::vector<uint8_t> &outputData,
+             SymbolTable &labelAddrMap,
+             Diagnostics &diagnostics,
+             AssemblerStats *stats) {
+    StatsTimer timer(stats, STATS_SECOND_PASS);
+    std::string_view currentLine;
+    size_t linePos = 0;
+    size_t line_number = 1;
+    unsigned int addrPointer = 0;
+    int instruction_count = 0;
+    int segment = SEGMENT_TEXT;
+    std::vector<std::string_view> data_labels;  // see countDataLine
+    IncbinSizes incbinSizes(diagnostics.file());
+    size_t first_redefinition = labelAddrMap.redefinitions();
+    std::vector<Instruction> instructions;
+    std::vector<std::string_view> labelCalls;
+    std::vector<LabelFixup> fixups;
+    MacroTable macros;
+    Expansion expansion;
+
+    for (; !diagnostics.limitReached() && nextLine(source, linePos, currentLine); ++line_number) {
+        LineTokens tokens = lexLine(currentLine, stats);
+        if (stats && !tokens.comment.empty()) ++stats->comments;
+        int kind = LINE_KIND_ORDINARY;
+        if (tokens.hasCode) {
+            kind = LINE_KIND_DEFINITION;
+            try {
+                if (!macros.define(tokens, currentLine)) {
+                    kind = LINE_KIND_DATA;
+                    if (segment == SEGMENT_TEXT && findDirective(tokens.mnemonic) < 0) {
+                        kind = LINE_KIND_EXPANDED;
+                        if (!macros.expand(tokens, currentLine, expansion)) kind = LINE_KIND_ORDINARY;
+                    }
+                }
+            } catch (const AssemblerError &e) {
+                if (kind == LINE_KIND_EXPANDED) {
+                    if (!tokens.label.empty()) labelAddrMap.set(tokens.labelName(), addrPointer);
+                    addrPointer += 4;
+                }
+                reportLineError(diagnostics, line_number, currentLine, tokens, e, outputListing, instructions,
+                                instruction_count, kind == LINE_KIND_DEFINITION ? 0 : 1);
+                continue;
+            }
+        }
+        if (kind == LINE_KIND_DEFINITION) {
+            if (outputListing) {
+                StatsTimer listing_timer(stats, STATS_LISTING);
+                sourcePrinting(*outputListing, tokens, currentLine);
+            }
+            continue;
+        }
+        if (kind == LINE_KIND_DATA) {
+            // same address counting as firstPass, the data is only read by assembleDataLine
+            int next_segment = segment;
+            uint32_t data_address = static_cast<uint32_t>(outputData.size());
+            countDataLine(tokens, currentLine, next_segment, data_address, addrPointer, data_labels, labelAddrMap,
+                          incbinSizes);
+            assembleDataLine(tokens, currentLine, line_number, segment, outputListing, instructions, outputData,
+                             incbinSizes, diagnostics, instruction_count, stats);
+            continue;
+        }
+        if (tokens.hasCode) {  // same address counting as firstPass
+            if (!tokens.label.empty()) {
+                labelAddrMap.set(tokens.labelName(), addrPointer);
+            }
+            if (kind == LINE_KIND_EXPANDED) {
+                addrPointer += static_cast<unsigned int>(4 * expansion.instructions.size());
+            } else if (!tokens.labelSingle) {
+                addrPointer += 4;
+            }
+        }
+        if (kind == LINE_KIND_EXPANDED) {
+            assembleExpansion(expansion, tokens, currentLine, line_number, labelAddrMap, outputListing, instructions,
+                              labelCalls, true, &fixups, diagnostics, instruction_count, stats);
+            continue;
+        }
+        if (!isInstruction(tokens)) {
+            if (outputListing) {
+                StatsTimer listing_timer(stats, STATS_LISTING);
+                outputPrinting(*outputListing, tokens, nullptr, 0, instruction_count);
+            }
+            continue;
+        }
+
+        Instruction instruction;
+        instruction.line = static_cast<uint32_t>(line_number);
+        bool undefined;
+        try {
+            undefined = parseInstruction(tokens, labelAddrMap, instruction_count, instruction, labelCalls, true);
+        } catch (const AssemblerError &e) {
+            reportLineError(diagnostics, line_number, currentLine, tokens, e, outputListing, instructions, instruction_count);
+            continue;
+        }
+        if (instruction.label != NO_LABEL) {
+            // "0x" + address + "    0x" precede the word in the listing
+            fixups.push_back({instructions.size(),
+                              instruction_count,
+                              outputListing ? outputListing->size() + 16 : 0,
+                              errorColumn(currentLine, tokens, labelCalls[instruction.label]),
+                              !undefined});
+        }
+        if (outputListing) {
+            StatsTimer listing_timer(stats, STATS_LISTING);
+            outputPrinting(*outputListing, tokens, &instruction, encodeInstruction(instruction), instruction_count);
+        }
+        instructions.push_back(instruction);
+        instruction_count += 4;
+    }
+    for (std::string_view name: data_labels) {
+        labelAddrMap.set(name, static_cast<uint32_t>(outputData.size()), SEGMENT_DATA);
+    }
+    if (stats) {
+        stats->lines += line_number - 1;
+        stats->labelResolutions += labelCalls.size();
+    }
+    if (diagnostics.limitReached()) return;
+
+    // patch forward references and, if a label was defined twice, the
+    // backward ones. An expansion may refer to a label twice but its line is
+    // reported once.
+    bool redefined = labelAddrMap.redefinitions() != first_redefinition;
+    uint32_t error_line = 0;
+    for (const auto &fixup: fixups) {
+        if (fixup.defined && !redefined) continue;
+        Instruction &instruction = instructions[fixup.index];
+        std::string_view labelCall = labelCalls[instruction.label];
+        try {
+            const SymbolTable::Symbol *symbol = labelAddrMap.findSymbol(labelCall);
+            if (!symbol) {
+                throw AssemblerError(std::string("label '") + std::string(labelCall) + "' does not exist!", std::string(labelCall));
+            }
+            instruction.immediate = symbolTarget(instruction.opcode, *symbol, fixup.instruction_count);
+            checkImmediate(instruction, labelCall);
+        } catch (const AssemblerError &e) {
+            if (instruction.line == error_line) continue;
+            error_line = instruction.line;
+            diagnostics.report(instruction.line, fixup.column, SEVERITY_ERROR, e.what());
+            if (outputListing) *outputListing << "Error: " << e.what() << "\n";
+            if (diagnostics.limitReached()) return;
+            continue;
+        }
+
+        if (outputListing) outputListing->patchHex(fixup.listingPos, encodeInstruction(instruction));
+    }
+    timer.stop();
+    {
+        StatsTimer encoding_timer(stats, STATS_ENCODING);
+        encodeInstructions(instructions, outputInstructions);
+    }
+
+    if (outputListing) {
+        StatsTimer listing_timer(stats, STATS_LISTING);
+        symbolsOutputPrinting(*outputListing, labelAddrMap);
+    }
+}
+
+// --------------------------------------------------------
+
+void objectPasses(std::string_view source,
+                  const std::string &name,
+                  OutputBuffer *outputListing,
+                  ObjectFile &object,
+                  SymbolTable &labelAddrMap,
+                  Diagnostics &diagnostics,
+                  AssemblerStats *stats) {
+    object.clear(name);
+    IncbinSizes incbinSizes(name);
+    firstPass(source, labelAddrMap, incbinSizes, stats);
+    std::vector<Instruction> instructions;
+    std::vector<std::string_view> labelCalls;
+    secondPassLines(source, 1, 0, outputListing, instructions, object.data, incbinSizes, labelCalls, labelAddrMap, true,
+                    diagnostics, stats);
+    {
+        StatsTimer timer(stats, STATS_ENCODING);
+        encodeInstructions(instructions, object.words);
+    }
+    if (outputListing && !diagnostics.limitReached()) {
+        StatsTimer timer(stats, STATS_LISTING);
+        symbolsOutputPrinting(*outputListing, labelAddrMap);
+    }
+
+    // the defined labels come first, the others are added when they are used
+    SymbolTable symbol_index;
+    for (const auto &symbol: labelAddrMap) {
+        uint32_t flags = OBJECT_SYMBOL_DEFINED | (symbol.segment == SEGMENT_DATA ? OBJECT_SYMBOL_DATA : 0);
+        symbol_index.set(symbol.name, static_cast<int>(object.addSymbol(symbol.name, symbol.address, flags)));
+    }
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        const Instruction &instruction = instructions[i];
+        if (instruction.label == NO_LABEL) continue;
+        std::string_view label = labelCalls[instruction.label];
+        bool defined = labelAddrMap.find(label) != nullptr;
+        if (defined && !takesAddress(instruction.opcode)) continue;
+
+        const int *index = symbol_index.find(label);
+        uint32_t symbol = index ? static_cast<uint32_t>(*index) : object.addSymbol(label, 0, 0);
+        if (!index) symbol_index.set(label, static_cast<int>(symbol));
+        object.relocations.push_back({static_cast<uint32_t>(i), symbol, instruction.line});
+    }
+}
+
+// --------------------------------------------------------
+
+bool incrementalPasses(std::string_view source,
+                       std::vector<uint32_t> &outputInstructions,
+                       SymbolTable &labelAddrMap,
+                       LineCache &cache,
+                       AssemblerStats *stats) {
+    // counted separately, the regular passes count again if a line has an error
+    AssemblerStats line_stats;
+    AssemblerStats *pass_stats = stats ? &line_stats : nullptr;
+    StatsTimer timer(pass_stats, STATS_SECOND_PASS);
+    LineCache lines;
+    lines.reset(std::count(source.begin(), source.end(), '\n') + 1);
+    std::vector<std::pair<CacheEntry *, int>> instructions;  // entry and address
+    std::vector<std::string_view> labelCalls;
+    const SymbolTable no_labels;
+    std::string_view currentLine;
+    size_t linePos = 0;
+    unsigned int addrPointer = 0;
+    int instruction_count = 0;
+
+    while (nextLine(source, linePos, currentLine)) {
+        uint64_t hash = LineCache::hashLine(currentLine);
+        auto [entry, inserted] = lines.insert(hash);
+        if (!inserted) {
+            // same text as an earlier line
+            ++line_stats.cachedLines;
+        } else if (const CacheEntry *cached = cache.find(hash)) {
+            *entry = *cached;
+            entry->label = lines.addString(cache.string(cached->label, cached->labelSize));
+            entry->labelCall = lines.addString(cache.string(cached->labelCall, cached->labelCallSize));
+            ++line_stats.cachedLines;
+        } else {
+            LineTokens tokens = lexLine(currentLine, pass_stats);
+            // a line that expands takes several words and data has its own
+            // addresses, such sources are left to the regular passes
+            if (findPseudo(tokens.mnemonic) >= 0 || tokens.mnemonic == ".macro" || findDirective(tokens.mnemonic) >= 0) {
+                return false;
+            }
+            if (!tokens.comment.empty()) entry->flags |= LINE_HAS_COMMENT;
+            if (tokens.hasCode) {
+                entry->flags |= LINE_HAS_CODE;
+                entry->label = lines.addString(tokens.labelName());
+                entry->labelSize = static_cast<uint32_t>(tokens.labelName().size());
+                if (!tokens.labelSingle) entry->flags |= LINE_TAKES_ADDRESS;
+            }
+            if (isInstruction(tokens)) {
+                entry->flags |= LINE_IS_INSTRUCTION;
+                labelCalls.clear();
+                try {
+                    parseInstruction(tokens, no_labels, 0, entry->instruction, labelCalls, true);
+                } catch (const AssemblerError &) {
+                    return false;
+                }
+                if (!labelCalls.empty()) {
+                    entry->labelCall = lines.addString(labelCalls[0]);
+                    entry->labelCallSize = static_cast<uint32_t>(labelCalls[0].size());
+                }
+                entry->instruction.label = NO_LABEL;
+                entry->word = encodeInstruction(entry->instruction);
+            }
+        }
+
+        ++line_stats.lines;
+        if (entry->flags & LINE_HAS_COMMENT) ++line_stats.comments;
+        if (entry->labelCallSize != 0) ++line_stats.labelResolutions;
+
+        // same address counting as firstPass
+        if (entry->flags & LINE_HAS_CODE) {
+            if (entry->labelSize != 0) {
+                labelAddrMap.set(lines.string(entry->label, entry->labelSize), addrPointer);
+            }
+            if (entry->flags & LINE_TAKES_ADDRESS) addrPointer += 4;
+        }
+        if (entry->flags & LINE_IS_INSTRUCTION) {
+            instructions.emplace_back(entry, instruction_count);
+            instruction_count += 4;
+        }
+    }
+
+    // encode again where the target of a label moved
+    timer.stop();
+    StatsTimer encoding_timer(pass_stats, STATS_ENCODING);
+    outputInstructions.reserve(outputInstructions.size() + instructions.size());
+    for (const auto &[entry, address]: instructions) {
+        if (entry->labelCallSize != 0) {
+            std::string_view labelCall = lines.string(entry->labelCall, entry->labelCallSize);
+            const int *label_address = labelAddrMap.find(labelCall);
+            if (!label_address) return false;
+            int target = labelTarget(entry->instruction.opcode, *label_address, address);
+            if (target != entry->instruction.immediate) {
+                entry->instruction.immediate = target;
+                try {
+                    checkImmediate(entry->instruction, labelCall);
+                } catch (const AssemblerError &) {
+                    return false;
+                }
+                entry->word = encodeInstruction(entry->instruction);
+            }
+        }
+        outputInstructions.push_back(entry->word);
+    }
+
+    encoding_timer.stop();
+    if (stats) stats->add(line_stats);
+    cache = std::move(lines);
+    return true;
+}
+
+// --------------------------------------------------------
+
+bool Assembler::assemble(std::string_view source, const std::string &name, LineCache *cache) {
+    AssemblerStats *stats = options_.stats;
+    uint64_t first_allocation = heapAllocations.load(std::memory_order_relaxed);
+    words_.clear();
+    data_.clear();
+    object_.clear();
+    symbols_.clear();
+    diagnostics_ = Diagnostics(name, options_.maxErrors);
+    OutputBuffer listing(listing_);
+    if (stats) {
+        ++stats->files;
+        stats->bytes += source.size();
+    }
+
+    // the regular passes report the errors and write the listing
+    bool assembled = cache && !options_.listing && !options_.object &&
+                     incrementalPasses(source, words_, symbols_, *cache, stats);
+    if (options_.object) {
+        objectPasses(source, name, options_.listing ? &listing : nullptr, object_, symbols_, diagnostics_, stats);
+    } else if (!assembled) {
+        words_.clear();
+        symbols_.clear();
+        OutputBuffer *outputListing = options_.listing ? &listing : nullptr;
+        if (options_.onePass) {
+            onePass(source, outputListing, words_, data_, symbols_, diagnostics_, stats);
+        } else {
+            parallelPasses(source, outputListing, words_, data_, symbols_, diagnostics_, options_.jobs, stats);
+        }
+    }
+
+    if (stats) {
+        stats->instructions += words_.size() + object_.words.size();
+        stats->labels += symbols_.size();
+        stats->allocations += heapAllocations.load(std::memory_order_relaxed) - first_allocation;
+    }
+    return !diagnostics_.hasErrors();
+}
@@ -0,0 +1,344 @@
+#ifndef MIPS_ASSEMBLER_H
+#define MIPS_ASSEMBLER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "cache.hpp"
+#include "diagnostics.hpp"
+#include "directives.hpp"
+#include "instruction.hpp"
+#include "object.hpp"
+#include "output.hpp"
+#include "stats.hpp"
+#include "symbols.hpp"
+
+/**
+ * @brief Error in a line of the assembled source.
+ */
+class AssemblerError : public std::runtime_error {
+   public:
+    /**
+     * @param message description of the problem
+     * @param token the part of the line that caused the error, used to find
+     * the column of the error
+     */
+    explicit AssemblerError(const std::string &message, std::string token = "")
+        : std::runtime_error(message)
+        , token_(std::move(token)) {}
+
+    const std::string &token() const { return token_; }
+
+   private:
+    std::string token_;
+};
+
+/**
+ * @brief Calls task(i) for every i in [0, count) on a pool of threads.
+ *
+ * @param count number of tasks
+ * @param jobs maximum number of threads, 0 for one per hardware thread
+ * @param task callable taking the index of the task
+ */
+template <typename Task>
+void runParallel(size_t count, unsigned jobs, Task task) {
+    std::atomic<size_t> next_task{0};
+    auto worker = [&]() {
+        for (size_t i = next_task++; i < count; i = next_task++) task(i);
+    };
+
+    if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+    jobs = static_cast<unsigned>(std::min<size_t>(jobs, count));
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < jobs; ++i) workers.emplace_back(worker);
+    worker();
+    for (auto &thread: workers) thread.join();
+}
+
+/**
+ * @brief Checks that the immediate of an I or J type instruction or the shift
+ * amount of an R type instruction fits into its field.
+ *
+ * @param instruction the parsed instruction
+ * @param token the operand of the immediate, used for the column of the error
+ * @throws AssemblerError if the immediate is too large
+ */
+void checkImmediate(const Instruction &instruction, std::string_view token);
+
+/**
+ * @brief Target of an instruction that refers to a label, see labelTarget.
+ *
+ * @param opcode INSTR_* of an instruction that takes a label
+ * @param symbol the label
+ * @param instruction_count address of the instruction
+ * @throws AssemblerError if a branch or jump refers to a label of the data
+ * segment, only lui and ori may take its address
+ */
+int symbolTarget(int opcode, const SymbolTable::Symbol &symbol, int instruction_count);
+
+/**
+ * @brief First pass to find the addresses for each lable that occur.
+ *
+ * @param source whole text of the file that contains the raw instructions
+ * @param labelAddrMap reference to the map that will store the numerical
+ * addresses of each label
+ * @param incbinSizes receives the sizes of the files of ".incbin", for the
+ * second pass
+ * @param stats receives the times and counters, nullptr if they are not needed
+ */
+void firstPass(std::string_view source,
+               SymbolTable &labelAddrMap,
+               IncbinSizes &incbinSizes,
+               AssemblerStats *stats = nullptr);
+
+/**
+ * @brief Parses the lines of a part of the source, see secondPass.
+ *
+ * @param text lines to parse
+ * @param first_line number of the first line in text
+ * @param instruction_count address of the first instruction in text
+ * @param outputListing output buffer for the listing, nullptr if no listing
+ * is generated
+ * @param instructions receives the parsed instructions
+ * @param data receives the data segment, text starts in the text segment
+ * @param incbinSizes sizes of the files of ".incbin" taken by firstPass
+ * @param labelCalls receives the names of the labels the instructions refer to
+ * @param labelAddrMap reference to a map that holds the numerical addresses for
+ * each label
+ * @param allowUndefined if true, a label that is not in labelAddrMap is
+ * encoded as 0 instead of being an error, see objectPasses
+ * @param diagnostics receives the errors, parsing stops when its error limit
+ * is reached
+ * @param stats receives the times and counters, nullptr if they are not needed
+ */
+void secondPassLines(std::string_view text,
+                     size_t first_line,
+                     int instruction_count,
+                     OutputBuffer *outputListing,
+                     std::vector<Instruction> &instructions,
+                     std::vector<uint8_t> &data,
+                     IncbinSizes &incbinSizes,
+                     std::vector<std::string_view> &labelCalls,
+                     const SymbolTable &labelAddrMap,
+                     bool allowUndefined,
+                     Diagnostics &diagnostics,
+                     AssemblerStats *stats = nullptr);
+
+/**
+ * @brief Second pass to validate the instructions, handle comments, split the
+ * instructions into their parts and eventually convert and print them.
+ *
+ * @param source whole text of the file that contains the raw instructions
+ * @param outputListing output buffer for the file containing the listing,
+ * nullptr if no listing is generated
+ * @param outputInstructions receives the binary instructions
+ * @param outputData receives the data segment, see directives.hpp
+ * @param incbinSizes sizes of the files of ".incbin" taken by firstPass
+ * @param labelAddrMap reference to a map that holds the numerical addresses for
+ * each label
+ * @param diagnostics receives the errors
+ * @param stats receives the times and counters, nullptr if they are not needed
+ */
+void secondPass(std::string_view source,
+                OutputBuffer *outputListing,
+                std::vector<uint32_t> &outputInstructions,
+                std::vector<uint8_t> &outputData,
+                IncbinSizes &incbinSizes,
+                SymbolTable &labelAddrMap,
+                Diagnostics &diagnostics,
+                AssemblerStats *stats = nullptr);
+
+/**
+ * @brief Assembles a large source by splitting it into chunks of lines. The
+ * first pass collects the labels and sizes of each chunk in parallel, the
+ * prefix sums of the sizes give the start address of each chunk. Then all
+ * chunks are encoded in parallel and their outputs are appended in order, so
+ * the result is the same as firstPass followed by secondPass. Sources with
+ * macros or a data segment are assembled as one chunk. The chunk that
+ * reaches the error limit is encoded again with the errors left over from
+ * the chunks before it, so assembling stops at the same line.
+ *
+ * @param source whole text of the file that contains the raw instructions
+ * @param outputListing output buffer for the file containing the listing,
+ * nullptr if no listing is generated
+ * @param outputInstructions receives the binary instructions
+ * @param outputData receives the data segment, see directives.hpp
+ * @param labelAddrMap reference to the map that will store the numerical
+ * addresses of each label
+ * @param diagnostics receives the errors, relative paths of ".incbin" are
+ * resolved against the directory of its file, see IncbinSizes
+ * @param jobs maximum number of threads, 0 for one per hardware thread
+ * @param stats receives the times and counters, nullptr if they are not needed
+ */
+void parallelPasses(std::string_view source,
+                    OutputBuffer *outputListing,
+                    std::vector<uint32_t> &outputInstructions,
+                    std::vector<uint8_t> &outputData,
+                    SymbolTable &labelAddrMap,
+                    Diagnostics &diagnostics,
+                    unsigned jobs,
+                    AssemblerStats *stats = nullptr);
+
+/**
+ * @brief Assembles the source in a single pass. Labels are collected while
+ * encoding, instructions that jump forward are written with a placeholder and
+ * patched in both outputs as soon as all labels are known. If a label is
+ * defined twice, the instructions before the second definition are patched
+ * as well, so every reference takes the last definition like in secondPass.
+ * The source is only read once. Labels that are never defined are reported
+ * after all lines were encoded.
+ *
+ * @param source whole text of the file that contains the raw instructions
+ * @param outputListing output buffer for the file containing the listing,
+ * nullptr if no listing is generated
+ * @param outputInstructions receives the binary instructions
+ * @param outputData receives the data segment, see directives.hpp
+ * @param labelAddrMap reference to the map that will store the numerical
+ * addresses of each label
+ * @param diagnostics receives the errors, relative paths of ".incbin" are
+ * resolved against the directory of its file, see IncbinSizes
+ * @param stats receives the times and counters, nullptr if they are not needed
+ */
+void onePass(std::string_view source,
+             OutputBuffer *outputListing,
+             std::vector<uint32_t> &outputInstructions,
+             std::vector<uint8_t> &outputData,
+             SymbolTable &labelAddrMap,
+             Diagnostics &diagnostics,
+             AssemblerStats *stats = nullptr);
+
+/**
+ * @brief Assembles the source into a relocatable object, see linkObjects.
+ * Labels that are not defined in the source are taken as labels of other
+ * objects. Every instruction that encodes the address of a label or refers
+ * to a label of another object gets a relocation. Branches within the source
+ * keep their offsets.
+ *
+ * @param source whole text of the file that contains the raw instructions
+ * @param name name of the source, stored in the object for the diagnostics
+ * of the linker; relative paths of ".incbin" are resolved against its
+ * directory
+ * @param outputListing output buffer for the file containing the listing,
+ * nullptr if no listing is generated
+ * @param object receives the instructions, data, symbols and relocations
+ * @param labelAddrMap reference to the map that will store the numerical
+ * addresses of each label
+ * @param diagnostics receives the errors
+ * @param stats receives the times and counters, nullptr if they are not needed
+ */
+void objectPasses(std::string_view source,
+                  const std::string &name,
+                  OutputBuffer *outputListing,
+                  ObjectFile &object,
+                  SymbolTable &labelAddrMap,
+                  Diagnostics &diagnostics,
+                  AssemblerStats *stats = nullptr);
+
+/**
+ * @brief Assembles the source with the results of the last run. Lines whose
+ * text is in the cache are neither lexed nor parsed again, the label
+ * addresses are computed from the cached line infos. Only instructions whose
+ * label target moved are encoded again. No listing is written. Sources with
+ * pseudo-instructions, macros or directives are left to the regular passes.
+ *
+ * @param source whole text of the file that contains the raw instructions
+ * @param outputInstructions receives the binary instructions
+ * @param labelAddrMap reference to the map that will store the numerical
+ * addresses of each label
+ * @param cache line infos of the last run, replaced by the ones of this run
+ * @param stats receives the times and counters, nullptr if they are not needed
+ * @return true, if the source was assembled. False if a line has an error,
+ * then the regular passes have to report it.
+ */
+bool incrementalPasses(std::string_view source,
+                       std::vector<uint32_t> &outputInstructions,
+                       SymbolTable &labelAddrMap,
+                       LineCache &cache,
+                       AssemblerStats *stats = nullptr);
+
+/**
+ * @brief Settings of an Assembler.
+ */
+struct AssemblerOptions {
+    bool listing = false;    // generate the listing with the symbol table
+    bool onePass = false;    // read the source once and backpatch labels
+    bool object = false;     // assemble into object(), see objectPasses
+    unsigned jobs = 1;       // worker threads for large sources, 0: one per hardware thread
+    size_t maxErrors = 50;   // 0: no limit
+    AssemblerStats *stats = nullptr;  // receives the times and counters of all calls
+};
+
+/**
+ * @brief Assembles sources that are already in memory and keeps the results
+ * in memory, so a program can use the assembler without files or processes.
+ * The buffers of the results are reused by the next call, an Assembler must
+ * only be used by one thread at a time.
+ */
+class Assembler {
+   public:
+    explicit Assembler(const AssemblerOptions &options = AssemblerOptions())
+        : options_(options) {}
+
+    AssemblerOptions &options() { return options_; }
+
+    /**
+     * @brief Assembles a whole source, the results of the last call are
+     * replaced.
+     *
+     * @param source text of the source
+     * @param name name of the source in the diagnostics, relative paths of
+     * ".incbin" are resolved against its directory
+     * @param cache line infos of the last run, see incrementalPasses. Only
+     * used if no listing is generated and not in object mode. Nullptr to
+     * assemble all lines.
+     * @return true, if the source was assembled without errors
+     */
+    bool assemble(std::string_view source, const std::string &name = "<source>", LineCache *cache = nullptr);
+
+    /**
+     * @brief Encoded instructions, the first one is at address 0. Empty if
+     * options().object is true.
+     */
+    const std::vector<uint32_t> &words() const { return words_; }
+
+    /**
+     * @brief Data segment, the first byte is at address 0 of the data memory.
+     * Empty if options().object is true.
+     */
+    const std::vector<uint8_t> &data() const { return data_; }
+
+    /**
+     * @brief Relocatable object, empty if options().object is false.
+     */
+    const ObjectFile &object() const { return object_; }
+
+    /**
+     * @brief Listing including the symbol table, empty if options().listing
+     * is false.
+     */
+    const std::string &listing() const { return listing_; }
+
+    /**
+     * @brief Address of every label.
+     */
+    const SymbolTable &symbols() const { return symbols_; }
+
+    const Diagnostics &diagnostics() const { return diagnostics_; }
+
+   private:
+    AssemblerOptions options_;
+    std::vector<uint32_t> words_;
+    std::vector<uint8_t> data_;
+    ObjectFile object_;
+    std::string listing_;
+    SymbolTable symbols_;
+    Diagnostics diagnostics_;
+};
+
+#endif
@@ -0,0 +1,508 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "assembler.hpp"
+#include "lexer.hpp"
+#include "source.hpp"
+
+namespace {
+
+/**
+ * @brief Share of the generated lines per kind of line, in percent. The rest
+ * are R and I type instructions.
+ */
+struct ProgramMix {
+    const char *name;
+    int labels;    // label in front of the instruction or on its own line
+    int comments;  // comment lines and comments behind instructions
+    int branches;  // beq and j to a label
+    int memory;    // lw and sw with "offset(base)"
+};
+
+const ProgramMix MIXES[] = {
+    {"default", 5, 10, 5, 10},
+    {"labels", 50, 5, 5, 5},
+    {"comments", 5, 60, 5, 5},
+    {"branches", 10, 5, 40, 5},
+    {"memory", 5, 5, 5, 50},
+};
+
+const char *const REGISTERS[] = {"$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7", "$s0", "$s1",
+                                 "$s2", "$s3", "$a0", "$a1", "$v0", "$v1", "$08", "$09", "$16", "$17"};
+const char *const R_INSTRUCTIONS[] = {"add", "sub", "and", "or", "nor", "slt"};
+
+// stages of the assembler that are timed separately
+enum {
+    STAGE_LEX,         // lexLine on every line
+    STAGE_REGEX_LEX,   // the std::regex lexer that lexLine replaced, see REGEX_LEX_LINES
+    STAGE_FIRST_PASS,  // firstPass
+    STAGE_PARSE,       // secondPass without listing, up to the instruction records
+    STAGE_HASH,        // findInstruction and findRegister on the names of the lines
+    STAGE_MAP,         // the same names looked up in a std::map, as before the perfect hashes
+    STAGE_ENCODE,      // encodeInstructions
+    STAGE_LISTING,     // secondPass with listing, including the parsing
+    STAGE_IMAGE,       // writeImage in hex format
+    STAGE_TOTAL,       // the default path of the command line without listing
+    STAGE_COUNT
+};
+
+// the regex lexer is about 200 times slower, it is timed on this many lines
+// at the start of the program and scaled to the whole program
+constexpr size_t REGEX_LEX_LINES = 20000;
+
+const char *const STAGE_NAMES[STAGE_COUNT] = {"lex",    "regex-lex", "first-pass", "parse", "hash",
+                                              "map",    "encode",    "listing",    "image", "total"};
+
+/**
+ * @brief Stream buffer that throws away everything, so output formatting is
+ * timed without the file system.
+ */
+class NullBuffer : public std::streambuf {
+   protected:
+    std::streamsize xsputn(const char *, std::streamsize count) override { return count; }
+    int overflow(int c) override { return traits_type::not_eof(c); }
+};
+
+/**
+ * @brief Generates a valid source file. Branches go to labels a few labels
+ * before or after the current line, so their offsets fit into 16 bits for
+ * any size of the program.
+ *
+ * @param lines number of lines
+ * @param mix share of each kind of line
+ * @param seed seed of the random numbers, the same seed gives the same source
+ */
+std::string generateProgram(size_t lines, const ProgramMix &mix, unsigned seed) {
+    std::mt19937 random(seed);
+    auto percent = [&](int share) { return static_cast<int>(random() % 100) < share; };
+    auto reg = [&]() { return REGISTERS[random() % (sizeof(REGISTERS) / sizeof(REGISTERS[0]))]; };
+    auto number = [&](int range) { return static_cast<int>(random() % range); };
+
+    std::ostringstream out;
+    int label_cnt = 0;
+    int label_max = -1;  // highest label that was referred to
+    for (size_t i = 0; i < lines; ++i) {
+        if (percent(mix.comments / 2)) {
+            out << "# comment line " << i << " with a few words in it\n";
+            continue;
+        }
+        if (percent(mix.labels)) {
+            out << "L" << label_cnt++ << ":";
+            if (percent(30)) {
+                out << "\n";
+                continue;
+            }
+            out << " ";
+        } else {
+            out << "    ";
+        }
+
+        int kind = number(100);
+        if (kind < mix.branches) {
+            int target = std::max(0, label_cnt - 8 + number(16));
+            label_max = std::max(label_max, target);
+            if (percent(70)) {
+                out << "beq " << reg() << ", " << reg() << ", L" << target;
+            } else {
+                out << "j L" << target;
+            }
+        } else if (kind < mix.branches + mix.memory) {
+            out << (percent(50) ? "lw " : "sw ") << reg() << ", " << 4 * number(1024) << "(" << reg() << ")";
+        } else if (percent(50)) {
+            out << R_INSTRUCTIONS[number(6)] << " " << reg() << ", " << reg() << ", " << reg();
+        } else if (percent(70)) {
+            out << "addi " << reg() << ", " << reg() << ", " << number(4096) - 2048;
+        } else {
+            out << "sll " << reg() << ", " << reg() << ", " << number(32);
+        }
+        if (percent(mix.comments / 2)) out << "    # trailing comment";
+        out << "\n";
+    }
+    for (; label_cnt <= label_max; ++label_cnt) out << "L" << label_cnt << ":\n";
+    out << "exit\n";
+    return out.str();
+}
+
+/**
+ * @brief Mnemonics and registers of the lines of a source, looked up by the
+ * stages STAGE_HASH and STAGE_MAP.
+ */
+struct SourceNames {
+    std::vector<std::string_view> mnemonics;
+    std::vector<std::string_view> registers;
+};
+
+/**
+ * @brief Collects the mnemonics and the register operands, including the
+ * bases of "offset(base)".
+ */
+SourceNames collectNames(std::string_view source) {
+    SourceNames names;
+    std::string_view line;
+    for (size_t pos = 0; nextLine(source, pos, line);) {
+        LineTokens tokens = lexLine(line);
+        if (tokens.mnemonic.empty()) continue;
+        names.mnemonics.push_back(tokens.mnemonic);
+        for (std::string_view operand: tokens.operands) {
+            if (!operand.empty() && operand[0] == '$') names.registers.push_back(operand);
+        }
+    }
+    return names;
+}
+
+/**
+ * @brief Parts of a line as the std::regex lexer returned them.
+ */
+struct RegexTokens {
+    std::string comment;
+    std::string label;
+    bool labelSingle = false;
+    std::vector<std::string> parts;  // mnemonic and operands in the order of the old second pass
+};
+
+/**
+ * @brief Line matching of the std::regex lexer that lexLine replaced, with the
+ * expressions of the former second pass, but without looking up the labels.
+ * Timed by STAGE_REGEX_LEX as the number from before the rewrite.
+ */
+class RegexLexer {
+   public:
+    RegexTokens lex(const std::string &line) const {
+        RegexTokens tokens;
+        std::smatch match;
+        if (std::regex_search(line, match, comment_)) tokens.comment = match.str(1);
+        if (!std::regex_search(line, code_line_) || !std::regex_search(line, match, code_)) return tokens;
+
+        std::string code = match.str(0);
+        if (std::regex_search(code, match, label_)) {
+            tokens.label = match.str(0);
+            tokens.labelSingle = !std::regex_search(code, code_after_label_);
+            code = std::regex_replace(code, label_, "");
+        }
+        if (std::regex_search(code, match, one_)) {
+            tokens.parts = {match.str(1)};
+        } else if (std::regex_search(code, match, two_)) {
+            tokens.parts = {match.str(1), match.str(2)};
+        } else if (std::regex_search(code, match, offset_) || std::regex_search(code, match, negative_offset_)) {
+            tokens.parts = {match.str(1), match.str(2), match.str(4), match.str(3)};
+        } else if (std::regex_search(code, match, three_)) {
+            tokens.parts = {match.str(1), match.str(2), match.str(3), match.str(4)};
+        }
+        return tokens;
+    }
+
+   private:
+    std::regex comment_{R"(.*(#.*))"};
+    std::regex code_line_{R"(^\s*[^\s#]+\s*#*)"};
+    std::regex code_{"[^#]*"};
+    std::regex label_{R"(\S*:)"};
+    std::regex code_after_label_{":[^#]*[^#\\s]#*"};
+    std::regex one_{R"(^\s*(\S+)\s*$)"};
+    std::regex two_{R"(^\s*(\S+)\s+(\S+)\s*$)"};
+    std::regex offset_{R"(^\s*(\S+)\s+(\S+),\s*(\d+)\((\S+)\)\s*$)"};
+    std::regex negative_offset_{R"(^\s*(\S+)\s+(\S+),\s*(-\d+)\((\S+)\)\s*$)"};
+    std::regex three_{R"(^\s*(\S+)\s+(\S+),\s*(\S+),\s*(\S+)\s*$)"};
+};
+
+/**
+ * @brief Runs task once and keeps its time in best if it is the fastest so
+ * far, best is 0 before the first run.
+ */
+template <typename Task>
+void keepBestTime(double &best, Task task) {
+    auto start = std::chrono::steady_clock::now();
+    task();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (best == 0 || elapsed.count() < best) best = elapsed.count();
+}
+
+/**
+ * @brief Times each stage for one source. The stages take turns, every round
+ * runs each of them once, so a machine that gets slower or faster during the
+ * run changes all stages alike and their shares of the total stay put.
+ *
+ * @param seconds receives the best time of each stage
+ * @return false, if the source doesn't assemble without errors
+ */
+bool timeStages(std::string_view source, int repeat, double seconds[STAGE_COUNT]) {
+    NullBuffer null_buffer;
+    std::ostream null_stream(&null_buffer);
+
+    // the number of operands keeps the compiler from dropping the lexer
+    size_t operand_cnt = 0;
+    auto lex = [&]() {
+        operand_cnt = 0;
+        std::string_view line;
+        for (size_t pos = 0; nextLine(source, pos, line);) {
+            LineTokens tokens = lexLine(line);
+            operand_cnt += !tokens.operands[0].empty() + !tokens.operands[1].empty() + !tokens.operands[2].empty();
+        }
+    };
+
+    // the regex lexer read a std::string per line like getline
+    RegexLexer regex_lexer;
+    size_t regex_operand_cnt = 0;
+    size_t regex_line_cnt = 0;
+    auto regex_lex = [&]() {
+        regex_operand_cnt = 0;
+        regex_line_cnt = 0;
+        std::string_view line;
+        std::string line_copy;
+        for (size_t pos = 0; regex_line_cnt < REGEX_LEX_LINES && nextLine(source, pos, line); ++regex_line_cnt) {
+            line_copy.assign(line);
+            RegexTokens tokens = regex_lexer.lex(line_copy);
+            if (!tokens.parts.empty()) regex_operand_cnt += tokens.parts.size() - 1;
+        }
+    };
+
+    SymbolTable labelAddrMap;
+    IncbinSizes incbinSizes;
+    auto first_pass = [&]() {
+        labelAddrMap.clear();
+        incbinSizes.clear();
+        firstPass(source, labelAddrMap, incbinSizes);
+    };
+
+    std::vector<Instruction> instructions;
+    std::vector<uint8_t> data;
+    std::vector<std::string_view> labelCalls;
+    Diagnostics diagnostics;
+    auto parse = [&](OutputBuffer *listing) {
+        instructions.clear();
+        data.clear();
+        labelCalls.clear();
+        diagnostics = Diagnostics();
+        secondPassLines(source, 1, 0, listing, instructions, data, incbinSizes, labelCalls, labelAddrMap, false,
+                        diagnostics);
+    };
+
+    // the sums of the results keep the compiler from dropping the lookups,
+    // both have to find the same
+    SourceNames names = collectNames(source);
+    long long hash_sum = 0;
+    auto hash = [&]() {
+        hash_sum = 0;
+        for (std::string_view name: names.mnemonics) hash_sum += findInstruction(name);
+        for (std::string_view name: names.registers) hash_sum += findRegister(name);
+    };
+
+    std::map<std::string, int, std::less<>> instruction_map, register_map;
+    for (size_t i = 0; i < INSTR_COUNT; ++i) instruction_map.emplace(INSTR_CODES[i].name, static_cast<int>(i));
+    for (const RegisterDef &reg: REGISTER_ABRV) register_map.emplace(reg.name, static_cast<int>(reg.number));
+    auto find = [](const std::map<std::string, int, std::less<>> &map, std::string_view name) {
+        auto result = map.find(name);
+        return result == map.end() ? -1 : result->second;
+    };
+    long long map_sum = 0;
+    auto map = [&]() {
+        map_sum = 0;
+        for (std::string_view name: names.mnemonics) map_sum += find(instruction_map, name);
+        for (std::string_view name: names.registers) map_sum += find(register_map, name);
+    };
+
+    std::vector<uint32_t> words;
+    auto total = [&]() {
+        SymbolTable labels;
+        std::vector<uint32_t> image;
+        std::vector<uint8_t> image_data;
+        Diagnostics total_diagnostics;
+        parallelPasses(source, nullptr, image, image_data, labels, total_diagnostics, 1);
+        writeImage(null_stream, image, IMAGE_FORMAT_HEX);
+    };
+
+    std::fill(seconds, seconds + STAGE_COUNT, 0.0);
+    for (int round = 0; round < repeat; ++round) {
+        keepBestTime(seconds[STAGE_LEX], lex);
+        keepBestTime(seconds[STAGE_REGEX_LEX], regex_lex);
+        keepBestTime(seconds[STAGE_FIRST_PASS], first_pass);
+        keepBestTime(seconds[STAGE_PARSE], [&]() { parse(nullptr); });
+        if (diagnostics.hasErrors()) {
+            diagnostics.writeText(std::cerr);
+            return false;
+        }
+        keepBestTime(seconds[STAGE_HASH], hash);
+        keepBestTime(seconds[STAGE_MAP], map);
+        keepBestTime(seconds[STAGE_ENCODE], [&]() {
+            words.clear();
+            encodeInstructions(instructions, words);
+        });
+        keepBestTime(seconds[STAGE_LISTING], [&]() {
+            OutputBuffer listing(null_stream);
+            parse(&listing);
+        });
+        keepBestTime(seconds[STAGE_IMAGE], [&]() { writeImage(null_stream, words, IMAGE_FORMAT_HEX); });
+        keepBestTime(seconds[STAGE_TOTAL], total);
+    }
+    if (operand_cnt == 0 || regex_operand_cnt == 0) return false;
+    if (hash_sum != map_sum) {
+        std::cerr << "the perfect hashes and the maps found different names\n";
+        return false;
+    }
+    seconds[STAGE_REGEX_LEX] *= static_cast<double>(std::count(source.begin(), source.end(), '\n')) / regex_line_cnt;
+    return true;
+}
+
+/**
+ * @brief Reads baseline numbers, one "<mix> <stage> <share>" per line, where
+ * share is the time of the stage divided by the time of STAGE_TOTAL for the
+ * same mix. Lines starting with '#' are skipped.
+ */
+bool readBaseline(const std::string &path, std::map<std::string, double> &baseline) {
+    std::ifstream file(path);
+    if (!file.is_open()) return false;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        std::string mix, stage;
+        double share;
+        if (!(fields >> mix >> stage >> share) || share <= 0) return false;
+        baseline[mix + " " + stage] = share;
+    }
+    return true;
+}
+
+void printUsage(std::ostream &out, const char *program) {
+    out << "usage: " << program << " [options]\n"
+        << "\n"
+        << "Times the stages of the assembler on generated programs and reports\n"
+        << "lines/s and MB/s of the source for each stage.\n"
+        << "\n"
+        << "options:\n"
+        << "  --lines <n>            lines per program (default 200000)\n"
+        << "  --mix <name>           default, labels, comments, branches or memory,\n"
+        << "                         may be repeated (default: all)\n"
+        << "  --repeat <n>           report the fastest of n runs (default 5)\n"
+        << "  --seed <n>             seed of the generator (default 1)\n"
+        << "  --write <file>         write the program of the first mix and exit\n"
+        << "  --baseline <file>      fail if a stage takes a larger share of the total\n"
+        << "                         time than stored\n"
+        << "  --tolerance <percent>  allowed slowdown against the baseline (default 25)\n"
+        << "  --save-baseline <file> store the shares of the stages as baseline\n";
+}
+
+}  // namespace
+
+// --------------------------------------------------------
+
+int main(int argc, char *argv[]) {
+    size_t lines = 200000;
+    int repeat = 5;
+    unsigned seed = 1;
+    double tolerance = 25;
+    std::vector<const ProgramMix *> mixes;
+    std::string write_path, baseline_path, save_path;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            printUsage(std::cout, argv[0]);
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            printUsage(std::cerr, argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--lines") {
+            lines = std::strtoul(value.c_str(), nullptr, 10);
+        } else if (arg == "--repeat") {
+            repeat = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--seed") {
+            seed = static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+        } else if (arg == "--tolerance") {
+            tolerance = std::atof(value.c_str());
+        } else if (arg == "--write") {
+            write_path = value;
+        } else if (arg == "--baseline") {
+            baseline_path = value;
+        } else if (arg == "--save-baseline") {
+            save_path = value;
+        } else if (arg == "--mix") {
+            auto mix = std::find_if(std::begin(MIXES), std::end(MIXES),
+                                    [&](const ProgramMix &m) { return value == m.name; });
+            if (mix == std::end(MIXES)) {
+                std::cerr << "unknown mix: " << value << "\n";
+                return 1;
+            }
+            mixes.push_back(mix);
+        } else {
+            printUsage(std::cerr, argv[0]);
+            return 1;
+        }
+    }
+    if (mixes.empty()) {
+        for (const ProgramMix &mix: MIXES) mixes.push_back(&mix);
+    }
+
+    if (!write_path.empty()) {
+        std::ofstream file(write_path);
+        file << generateProgram(lines, *mixes[0], seed);
+        return file ? 0 : 1;
+    }
+
+    std::map<std::string, double> baseline;
+    if (!baseline_path.empty() && !readBaseline(baseline_path, baseline)) {
+        std::cerr << "can't read baseline " << baseline_path << "\n";
+        return 1;
+    }
+    std::ofstream save_file;
+    if (!save_path.empty()) {
+        save_file.open(save_path);
+        save_file << "# mix stage time/total, " << lines << " lines per program\n";
+    }
+
+    int regressions = 0;
+    std::cout << "mix       stage            ms       Mlines/s       MB/s   baseline\n";
+    for (const ProgramMix *mix: mixes) {
+        std::string source = generateProgram(lines, *mix, seed);
+        size_t line_cnt = std::count(source.begin(), source.end(), '\n');
+        double seconds[STAGE_COUNT];
+        if (!timeStages(source, repeat, seconds)) {
+            std::cerr << "generated program of mix " << mix->name << " has errors\n";
+            return 1;
+        }
+
+        for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+            double lines_per_second = line_cnt / seconds[stage];
+            char row[128];
+            std::snprintf(row, sizeof(row), "%-9s %-10s %8.2f %14.2f %10.1f", mix->name, STAGE_NAMES[stage],
+                          seconds[stage] * 1e3, lines_per_second / 1e6, source.size() / seconds[stage] / 1e6);
+            std::cout << row;
+
+            // the share of the total time hardly depends on the machine, so
+            // the baseline holds the shares; the total itself isn't compared
+            double share = seconds[stage] / seconds[STAGE_TOTAL];
+            auto expected = stage == STAGE_TOTAL ? baseline.end()
+                                                 : baseline.find(std::string(mix->name) + " " + STAGE_NAMES[stage]);
+            if (expected != baseline.end()) {
+                double change = (expected->second / share - 1) * 100;
+                std::snprintf(row, sizeof(row), " %+9.1f%%", change);
+                std::cout << row;
+                if (change < -tolerance) {
+                    std::cout << "  REGRESSION";
+                    ++regressions;
+                }
+            }
+            std::cout << "\n";
+            if (save_file.is_open() && stage != STAGE_TOTAL) {
+                save_file << mix->name << " " << STAGE_NAMES[stage] << " " << share << "\n";
+            }
+        }
+    }
+
+    if (regressions != 0) {
+        std::cerr << regressions << " stages are more than " << tolerance << "% slower than the baseline, relative to the total\n";
+        return 1;
+    }
+    return 0;
+}
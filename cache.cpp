@@ -0,0 +1,132 @@
+#include "cache.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+#include "source.hpp"
+
+namespace {
+
+static_assert(std::is_trivially_copyable_v<CacheEntry>, "entries are stored as they are");
+
+// changes whenever the layout of the file or of CacheEntry changes
+constexpr std::string_view CACHE_MAGIC = "MIPSLC04";
+
+/**
+ * @brief Layout of the beginning of a cache file. The used entries of the
+ * table and the label names follow it.
+ */
+struct CacheHeader {
+    char magic[8];
+    uint64_t entryCount;
+    uint64_t stringSize;
+};
+
+/**
+ * @brief Checks the fields of an entry read from a file that index into the
+ * label names, INSTR_CODES or the fields of the encoded word, so a damaged
+ * file can't make the passes read out of bounds.
+ */
+bool isValidEntry(const CacheEntry &entry, uint64_t string_size) {
+    const Instruction &instruction = entry.instruction;
+    return entry.hash != 0 && uint64_t(entry.label) + entry.labelSize <= string_size &&
+           uint64_t(entry.labelCall) + entry.labelCallSize <= string_size && instruction.opcode < INSTR_COUNT &&
+           instruction.rd < 32 && instruction.rs < 32 && instruction.rt < 32;
+}
+
+}  // namespace
+
+// --------------------------------------------------------
+
+bool LineCache::load(const std::string &path) {
+    reset(0);
+    SourceFile file;
+    if (!file.open(path)) return false;
+
+    std::string_view data = file.text();
+    CacheHeader header;
+    if (data.size() < sizeof(header)) return false;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::string_view(header.magic, sizeof(header.magic)) != CACHE_MAGIC ||
+        (data.size() - sizeof(header)) / sizeof(CacheEntry) < header.entryCount ||
+        data.size() - sizeof(header) - header.entryCount * sizeof(CacheEntry) != header.stringSize) {
+        return false;
+    }
+
+    reset(header.entryCount);
+    const char *entries = data.data() + sizeof(header);
+    for (uint64_t i = 0; i < header.entryCount; ++i) {
+        CacheEntry entry;
+        std::memcpy(&entry, entries + i * sizeof(CacheEntry), sizeof(CacheEntry));
+        if (!isValidEntry(entry, header.stringSize)) {
+            reset(0);  // all lines are assembled again
+            return false;
+        }
+        *insert(entry.hash).first = entry;
+    }
+    strings_.assign(data.substr(sizeof(header) + header.entryCount * sizeof(CacheEntry)));
+    return true;
+}
+
+// --------------------------------------------------------
+
+bool LineCache::save(const std::string &path) const {
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return false;
+
+    std::vector<CacheEntry> entries;
+    for (const CacheEntry &entry: slots_) {
+        if (entry.hash != 0) entries.push_back(entry);
+    }
+
+    CacheHeader header;
+    std::memcpy(header.magic, CACHE_MAGIC.data(), sizeof(header.magic));
+    header.entryCount = entries.size();
+    header.stringSize = strings_.size();
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(entries.data()),
+               static_cast<std::streamsize>(entries.size() * sizeof(CacheEntry)));
+    file.write(strings_.data(), static_cast<std::streamsize>(strings_.size()));
+    return static_cast<bool>(file);
+}
+
+// --------------------------------------------------------
+
+void LineCache::reset(size_t lines) {
+    // at most half of the slots are used
+    size_t slot_cnt = 16;
+    while (slot_cnt < 2 * lines) slot_cnt *= 2;
+    slots_.assign(slot_cnt, CacheEntry{});
+    strings_.clear();
+}
+
+// --------------------------------------------------------
+
+const CacheEntry *LineCache::find(uint64_t hash) const {
+    if (slots_.empty()) return nullptr;  // neither loaded nor reset
+    for (size_t i = slot(hash);; i = (i + 1) & (slots_.size() - 1)) {
+        if (slots_[i].hash == hash) return &slots_[i];
+        if (slots_[i].hash == 0) return nullptr;
+    }
+}
+
+// --------------------------------------------------------
+
+std::pair<CacheEntry *, bool> LineCache::insert(uint64_t hash) {
+    for (size_t i = slot(hash);; i = (i + 1) & (slots_.size() - 1)) {
+        if (slots_[i].hash == hash) return {&slots_[i], false};
+        if (slots_[i].hash == 0) {
+            slots_[i].hash = hash;
+            return {&slots_[i], true};
+        }
+    }
+}
+
+// --------------------------------------------------------
+
+uint32_t LineCache::addString(std::string_view s) {
+    uint32_t offset = static_cast<uint32_t>(strings_.size());
+    strings_.append(s.data(), s.size());
+    return offset;
+}
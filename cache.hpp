@@ -0,0 +1,101 @@
+#ifndef MIPS_CACHE_H
+#define MIPS_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "instruction.hpp"
+
+// what the passes have to know about a line, see CacheEntry
+enum {
+    LINE_HAS_CODE = 1,        // the line counts for the label addresses
+    LINE_TAKES_ADDRESS = 2,   // the line moves the label address by 4
+    LINE_IS_INSTRUCTION = 4,  // the line is encoded into a word
+    LINE_HAS_COMMENT = 8      // only used for the stats
+};
+
+/**
+ * @brief Result of both passes for the text of a single line. It only depends
+ * on the text, apart from the target of an instruction that refers to a
+ * label. The entries are stored in the cache file as they are.
+ */
+struct CacheEntry {
+    uint64_t hash = 0;        // hash of the text, 0 marks an empty slot
+    Instruction instruction;  // line is not used
+    uint32_t word = 0;        // encoded instruction
+    uint32_t flags = 0;       // LINE_*
+    uint32_t label = 0;       // label defined by the line, see LineCache::string
+    uint32_t labelSize = 0;
+    uint32_t labelCall = 0;   // label the instruction refers to
+    uint32_t labelCallSize = 0;
+};
+
+/**
+ * @brief Persistent hash table from the text of a line to its CacheEntry. It
+ * is kept in a local file next to the outputs, so a file that changed in a
+ * few lines is only parsed in those lines on the next run. The table uses
+ * open addressing and never grows, so pointers to entries stay valid.
+ */
+class LineCache {
+   public:
+    /**
+     * @brief Replaces the contents with the cache stored in a file. The
+     * cache stays empty if the file is damaged.
+     *
+     * @return true, if the file exists, was written by this version and all
+     * its entries are valid
+     */
+    bool load(const std::string &path);
+
+    /**
+     * @return true, if the file was written completely
+     */
+    bool save(const std::string &path) const;
+
+    /**
+     * @brief Clears the table and makes room for the given number of lines.
+     */
+    void reset(size_t lines);
+
+    /**
+     * @return const CacheEntry* nullptr, if the line is not in the cache
+     */
+    const CacheEntry *find(uint64_t hash) const;
+
+    /**
+     * @brief Adds an empty entry for a line, if the line is not in the table
+     * yet. There must be room for it, see reset.
+     *
+     * @return std::pair<CacheEntry *, bool> the entry of the line and whether
+     * it was added
+     */
+    std::pair<CacheEntry *, bool> insert(uint64_t hash);
+
+    /**
+     * @brief Stores a label name.
+     *
+     * @return uint32_t offset of the name for CacheEntry
+     */
+    uint32_t addString(std::string_view s);
+
+    std::string_view string(uint32_t offset, uint32_t size) const { return std::string_view(strings_).substr(offset, size); }
+
+    /**
+     * @brief 64 bit FNV-1a hash of the text of a line, never 0.
+     */
+    static uint64_t hashLine(std::string_view line) {
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (char c: line) hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001B3ull;
+        return hash == 0 ? 1 : hash;
+    }
+
+   private:
+    size_t slot(uint64_t hash) const { return (hash ^ (hash >> 29)) & (slots_.size() - 1); }
+
+    std::vector<CacheEntry> slots_;  // size is a power of 2
+    std::string strings_;
+};
+
+#endif
@@ -1,41 +1,289 @@
 #ifndef MIPS_DEFINITIONS_H
 #define MIPS_DEFINITIONS_H
 
-#include <map>
-#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
 
+// bit-field layouts of the instructions
 enum {
-    INSTR_TYPE_R,
-    INSTR_TYPE_R_SHIFT,
-    INSTR_TYPE_I,
-    INSTR_TYPE_J,
-    INSTR_TYPE_NULL
+    INSTR_TYPE_R,     // op rs rt rd sa function
+    INSTR_TYPE_I,     // op rs rt immediate
+    INSTR_TYPE_J,     // op target
+    INSTR_TYPE_NULL,  // encoded as 0
+    INSTR_TYPE_EXIT   // encoded as ~0u, stops the simulation
+};
+
+// op codes that select the instruction by another field
+constexpr uint32_t OP_SPECIAL = 0x00;   // by function
+constexpr uint32_t OP_REGIMM = 0x01;    // by rt
+constexpr uint32_t OP_SPECIAL2 = 0x1C;  // by function
+
+// fields of an Instruction an operand is parsed into
+enum {
+    FIELD_RD,
+    FIELD_RS,
+    FIELD_RT,
+    FIELD_IMMEDIATE,  // number: immediate, offset or shift amount
+    FIELD_LABEL       // label or number: branch offset or jump target
+};
+
+/**
+ * @brief Operands of an instruction in the source. The parts of a line are
+ * ordered {instr, rt, rs, imm} for "instr rt, imm(rs)" and {instr, a, b, c}
+ * otherwise, see instructionParts. The operands are parsed in the order of
+ * the table, which decides which error is reported first.
+ */
+struct OperandSyntax {
+    uint8_t partCount;  // number of parts including the mnemonic, 1 accepts any
+    uint8_t operandCount;
+    struct {
+        uint8_t part;   // index into the parts
+        uint8_t field;  // FIELD_*
+    } operands[3];
+    uint8_t fixedRd;  // rd of instructions that write a fixed register
+};
+
+// index of each syntax in INSTR_SYNTAX
+enum {
+    SYNTAX_NONE,            // "nop"
+    SYNTAX_RD_RS_RT,        // "add rd, rs, rt"
+    SYNTAX_RD_RT_SA,        // "sll rd, rt, sa"
+    SYNTAX_RD_RT_RS,        // "sllv rd, rt, rs"
+    SYNTAX_RS_RT,           // "mult rs, rt"
+    SYNTAX_RD,              // "mfhi rd"
+    SYNTAX_RS,              // "jr rs"
+    SYNTAX_RS_LINK,         // "jalr rs", links to $ra
+    SYNTAX_RT_RS_IMM,       // "addi rt, rs, imm"
+    SYNTAX_RT_IMM,          // "lui rt, imm"
+    SYNTAX_RT_OFFSET_BASE,  // "lw rt, offset(base)"
+    SYNTAX_RS_RT_LABEL,     // "beq rs, rt, label"
+    SYNTAX_RS_LABEL,        // "bgez rs, label"
+    SYNTAX_TARGET,          // "j label"
+    SYNTAX_RT_HI,           // "lui rt, %hi(label)"
+    SYNTAX_RT_RS_LO         // "ori rt, rs, %lo(label)"
+};
+
+constexpr OperandSyntax INSTR_SYNTAX[] = {
+    {1, 0, {}, 0},
+    {4, 3, {{2, FIELD_RS}, {3, FIELD_RT}, {1, FIELD_RD}}, 0},
+    {4, 3, {{2, FIELD_RT}, {1, FIELD_RD}, {3, FIELD_IMMEDIATE}}, 0},
+    {4, 3, {{3, FIELD_RS}, {2, FIELD_RT}, {1, FIELD_RD}}, 0},
+    {3, 2, {{1, FIELD_RS}, {2, FIELD_RT}}, 0},
+    {2, 1, {{1, FIELD_RD}}, 0},
+    {2, 1, {{1, FIELD_RS}}, 0},
+    {2, 1, {{1, FIELD_RS}}, 31},
+    {4, 3, {{3, FIELD_IMMEDIATE}, {2, FIELD_RS}, {1, FIELD_RT}}, 0},
+    {3, 2, {{2, FIELD_IMMEDIATE}, {1, FIELD_RT}}, 0},
+    {4, 3, {{3, FIELD_IMMEDIATE}, {2, FIELD_RS}, {1, FIELD_RT}}, 0},
+    {4, 3, {{3, FIELD_LABEL}, {1, FIELD_RS}, {2, FIELD_RT}}, 0},
+    {3, 2, {{2, FIELD_LABEL}, {1, FIELD_RS}}, 0},
+    {2, 1, {{1, FIELD_LABEL}}, 0},
+    {3, 2, {{2, FIELD_LABEL}, {1, FIELD_RT}}, 0},
+    {4, 3, {{3, FIELD_LABEL}, {2, FIELD_RS}, {1, FIELD_RT}}, 0}};
+
+// index of each instruction in INSTR_CODES
+enum {
+    INSTR_ADD,
+    INSTR_SUB,
+    INSTR_AND,
+    INSTR_OR,
+    INSTR_NOR,
+    INSTR_SLT,
+    INSTR_LW,
+    INSTR_SW,
+    INSTR_BEQ,
+    INSTR_ADDI,
+    INSTR_SLL,
+    INSTR_J,
+    INSTR_JR,
+    INSTR_NOP,
+    INSTR_EXIT,
+    INSTR_ADDU,
+    INSTR_SUBU,
+    INSTR_XOR,
+    INSTR_SLTU,
+    INSTR_SRL,
+    INSTR_SRA,
+    INSTR_SLLV,
+    INSTR_SRLV,
+    INSTR_SRAV,
+    INSTR_JALR,
+    INSTR_MFHI,
+    INSTR_MTHI,
+    INSTR_MFLO,
+    INSTR_MTLO,
+    INSTR_MULT,
+    INSTR_MULTU,
+    INSTR_DIV,
+    INSTR_DIVU,
+    INSTR_MUL,
+    INSTR_BLTZ,
+    INSTR_BGEZ,
+    INSTR_BLTZAL,
+    INSTR_BGEZAL,
+    INSTR_JAL,
+    INSTR_BNE,
+    INSTR_BLEZ,
+    INSTR_BGTZ,
+    INSTR_ADDIU,
+    INSTR_SLTI,
+    INSTR_SLTIU,
+    INSTR_ANDI,
+    INSTR_ORI,
+    INSTR_XORI,
+    INSTR_LUI,
+    INSTR_LB,
+    INSTR_LH,
+    INSTR_LBU,
+    INSTR_LHU,
+    INSTR_SB,
+    INSTR_SH,
+    INSTR_COUNT
 };
 
 struct InstructionCodes {
     uint32_t op_code = 0x00;
     uint32_t format = 0x00;
-    uint32_t function = 0x00;
-};
-
-const std::map<std::string, InstructionCodes> INSTR_CODES = {
-    {"add", {0x00, INSTR_TYPE_R, 0x20}},        // R, 0x20
-    {"sub", {0x00, INSTR_TYPE_R, 0x22}},        // R, 0x22
-    {"and", {0x00, INSTR_TYPE_R, 0x24}},        // R, 0x24
-    {"or", {0x00, INSTR_TYPE_R, 0x25}},         // R, 0x25
-    {"nor", {0x00, INSTR_TYPE_R, 0x27}},        // R, 0x27
-    {"slt", {0x00, INSTR_TYPE_R, 0x2A}},        // R, 0x2A
-    {"lw", {0x23, INSTR_TYPE_I, 0x00}},         // I, NA
-    {"sw", {0x2B, INSTR_TYPE_I, 0x00}},         // I, NA
-    {"beq", {0x04, INSTR_TYPE_I, 0x00}},        // I, NA
-    {"addi", {0x08, INSTR_TYPE_I, 0x00}},       // I, NA
-    {"sll", {0x00, INSTR_TYPE_R_SHIFT, 0x00}},  // R, 0x00
-    {"j", {0x02, INSTR_TYPE_J, 0x00}},          // J, NA
-    {"jr", {0x00, INSTR_TYPE_R, 0x08}},         // R, 0x08
-    {"nop", {0x00, INSTR_TYPE_NULL, 0x00}}};
+    uint32_t function = 0x00;  // function of R type, rt of REGIMM branches
+};
+
+struct InstructionDef {
+    std::string_view name;
+    InstructionCodes codes;
+    uint8_t syntax;  // SYNTAX_*
+};
+
+/**
+ * @brief The supported instructions, the MIPS32 integer instructions without
+ * traps, unaligned and atomic memory access. Everything the assembler, the
+ * encoder, the decoder and the listing know about an instruction is taken
+ * from here, so adding an instruction is adding a line and its INSTR_* index.
+ */
+constexpr InstructionDef INSTR_CODES[] = {
+    {"add", {OP_SPECIAL, INSTR_TYPE_R, 0x20}, SYNTAX_RD_RS_RT},
+    {"sub", {OP_SPECIAL, INSTR_TYPE_R, 0x22}, SYNTAX_RD_RS_RT},
+    {"and", {OP_SPECIAL, INSTR_TYPE_R, 0x24}, SYNTAX_RD_RS_RT},
+    {"or", {OP_SPECIAL, INSTR_TYPE_R, 0x25}, SYNTAX_RD_RS_RT},
+    {"nor", {OP_SPECIAL, INSTR_TYPE_R, 0x27}, SYNTAX_RD_RS_RT},
+    {"slt", {OP_SPECIAL, INSTR_TYPE_R, 0x2A}, SYNTAX_RD_RS_RT},
+    {"lw", {0x23, INSTR_TYPE_I, 0x00}, SYNTAX_RT_OFFSET_BASE},
+    {"sw", {0x2B, INSTR_TYPE_I, 0x00}, SYNTAX_RT_OFFSET_BASE},
+    {"beq", {0x04, INSTR_TYPE_I, 0x00}, SYNTAX_RS_RT_LABEL},
+    {"addi", {0x08, INSTR_TYPE_I, 0x00}, SYNTAX_RT_RS_IMM},
+    {"sll", {OP_SPECIAL, INSTR_TYPE_R, 0x00}, SYNTAX_RD_RT_SA},
+    {"j", {0x02, INSTR_TYPE_J, 0x00}, SYNTAX_TARGET},
+    {"jr", {OP_SPECIAL, INSTR_TYPE_R, 0x08}, SYNTAX_RS},
+    {"nop", {0x00, INSTR_TYPE_NULL, 0x00}, SYNTAX_NONE},
+    {"exit", {0x00, INSTR_TYPE_EXIT, 0x00}, SYNTAX_NONE},
+    {"addu", {OP_SPECIAL, INSTR_TYPE_R, 0x21}, SYNTAX_RD_RS_RT},
+    {"subu", {OP_SPECIAL, INSTR_TYPE_R, 0x23}, SYNTAX_RD_RS_RT},
+    {"xor", {OP_SPECIAL, INSTR_TYPE_R, 0x26}, SYNTAX_RD_RS_RT},
+    {"sltu", {OP_SPECIAL, INSTR_TYPE_R, 0x2B}, SYNTAX_RD_RS_RT},
+    {"srl", {OP_SPECIAL, INSTR_TYPE_R, 0x02}, SYNTAX_RD_RT_SA},
+    {"sra", {OP_SPECIAL, INSTR_TYPE_R, 0x03}, SYNTAX_RD_RT_SA},
+    {"sllv", {OP_SPECIAL, INSTR_TYPE_R, 0x04}, SYNTAX_RD_RT_RS},
+    {"srlv", {OP_SPECIAL, INSTR_TYPE_R, 0x06}, SYNTAX_RD_RT_RS},
+    {"srav", {OP_SPECIAL, INSTR_TYPE_R, 0x07}, SYNTAX_RD_RT_RS},
+    {"jalr", {OP_SPECIAL, INSTR_TYPE_R, 0x09}, SYNTAX_RS_LINK},
+    {"mfhi", {OP_SPECIAL, INSTR_TYPE_R, 0x10}, SYNTAX_RD},
+    {"mthi", {OP_SPECIAL, INSTR_TYPE_R, 0x11}, SYNTAX_RS},
+    {"mflo", {OP_SPECIAL, INSTR_TYPE_R, 0x12}, SYNTAX_RD},
+    {"mtlo", {OP_SPECIAL, INSTR_TYPE_R, 0x13}, SYNTAX_RS},
+    {"mult", {OP_SPECIAL, INSTR_TYPE_R, 0x18}, SYNTAX_RS_RT},
+    {"multu", {OP_SPECIAL, INSTR_TYPE_R, 0x19}, SYNTAX_RS_RT},
+    {"div", {OP_SPECIAL, INSTR_TYPE_R, 0x1A}, SYNTAX_RS_RT},
+    {"divu", {OP_SPECIAL, INSTR_TYPE_R, 0x1B}, SYNTAX_RS_RT},
+    {"mul", {OP_SPECIAL2, INSTR_TYPE_R, 0x02}, SYNTAX_RD_RS_RT},
+    {"bltz", {OP_REGIMM, INSTR_TYPE_I, 0x00}, SYNTAX_RS_LABEL},
+    {"bgez", {OP_REGIMM, INSTR_TYPE_I, 0x01}, SYNTAX_RS_LABEL},
+    {"bltzal", {OP_REGIMM, INSTR_TYPE_I, 0x10}, SYNTAX_RS_LABEL},
+    {"bgezal", {OP_REGIMM, INSTR_TYPE_I, 0x11}, SYNTAX_RS_LABEL},
+    {"jal", {0x03, INSTR_TYPE_J, 0x00}, SYNTAX_TARGET},
+    {"bne", {0x05, INSTR_TYPE_I, 0x00}, SYNTAX_RS_RT_LABEL},
+    {"blez", {0x06, INSTR_TYPE_I, 0x00}, SYNTAX_RS_LABEL},
+    {"bgtz", {0x07, INSTR_TYPE_I, 0x00}, SYNTAX_RS_LABEL},
+    {"addiu", {0x09, INSTR_TYPE_I, 0x00}, SYNTAX_RT_RS_IMM},
+    {"slti", {0x0A, INSTR_TYPE_I, 0x00}, SYNTAX_RT_RS_IMM},
+    {"sltiu", {0x0B, INSTR_TYPE_I, 0x00}, SYNTAX_RT_RS_IMM},
+    {"andi", {0x0C, INSTR_TYPE_I, 0x00}, SYNTAX_RT_RS_IMM},
+    {"ori", {0x0D, INSTR_TYPE_I, 0x00}, SYNTAX_RT_RS_IMM},
+    {"xori", {0x0E, INSTR_TYPE_I, 0x00}, SYNTAX_RT_RS_IMM},
+    {"lui", {0x0F, INSTR_TYPE_I, 0x00}, SYNTAX_RT_IMM},
+    {"lb", {0x20, INSTR_TYPE_I, 0x00}, SYNTAX_RT_OFFSET_BASE},
+    {"lh", {0x21, INSTR_TYPE_I, 0x00}, SYNTAX_RT_OFFSET_BASE},
+    {"lbu", {0x24, INSTR_TYPE_I, 0x00}, SYNTAX_RT_OFFSET_BASE},
+    {"lhu", {0x25, INSTR_TYPE_I, 0x00}, SYNTAX_RT_OFFSET_BASE},
+    {"sb", {0x28, INSTR_TYPE_I, 0x00}, SYNTAX_RT_OFFSET_BASE},
+    {"sh", {0x29, INSTR_TYPE_I, 0x00}, SYNTAX_RT_OFFSET_BASE}};
+
+static_assert(sizeof(INSTR_CODES) / sizeof(INSTR_CODES[0]) == INSTR_COUNT, "INSTR_* and INSTR_CODES differ");
+
+/**
+ * @return const OperandSyntax& operands of an instruction
+ */
+constexpr const OperandSyntax &instructionSyntax(int opcode) { return INSTR_SYNTAX[INSTR_CODES[opcode].syntax]; }
+
+/**
+ * @return true, if the syntax of the instruction has a label operand
+ */
+constexpr bool takesLabel(int opcode) {
+    const OperandSyntax &syntax = instructionSyntax(opcode);
+    for (int i = 0; i < syntax.operandCount; ++i) {
+        if (syntax.operands[i].field == FIELD_LABEL) return true;
+    }
+    return false;
+}
+
+// index of each pseudo-instruction in PSEUDO_CODES
+enum {
+    PSEUDO_LI,
+    PSEUDO_LA,
+    PSEUDO_MOVE,
+    PSEUDO_NOT,
+    PSEUDO_NEG,
+    PSEUDO_B,
+    PSEUDO_BEQZ,
+    PSEUDO_BNEZ,
+    PSEUDO_BLT,
+    PSEUDO_BGT,
+    PSEUDO_BLE,
+    PSEUDO_BGE,
+    PSEUDO_COUNT
+};
+
+struct PseudoDef {
+    std::string_view name;
+    uint8_t operandCount;
+};
+
+/**
+ * @brief Pseudo-instructions, they are expanded into the instructions of
+ * INSTR_CODES by expandPseudo in macros.cpp. The branches use $at.
+ */
+constexpr PseudoDef PSEUDO_CODES[] = {
+    {"li", 2},    // rt, imm: addiu, lui or lui + ori
+    {"la", 2},    // rt, label: lui + ori
+    {"move", 2},  // rd, rs: addu
+    {"not", 2},   // rd, rs: nor
+    {"neg", 2},   // rd, rs: sub
+    {"b", 1},     // label: beq
+    {"beqz", 2},  // rs, label: beq
+    {"bnez", 2},  // rs, label: bne
+    {"blt", 3},   // rs, rt, label: slt + bne
+    {"bgt", 3},   // rs, rt, label: slt + bne
+    {"ble", 3},   // rs, rt, label: slt + beq
+    {"bge", 3}};  // rs, rt, label: slt + beq
+
+static_assert(sizeof(PSEUDO_CODES) / sizeof(PSEUDO_CODES[0]) == PSEUDO_COUNT, "PSEUDO_* and PSEUDO_CODES differ");
+
+struct RegisterDef {
+    std::string_view name;
+    uint32_t number;
+};
 
 // register abbreviations
-const std::map<std::string, uint32_t> REGISTER_ABRV = {
+constexpr RegisterDef REGISTER_ABRV[] = {
     {"$zero", 0}, {"$at", 1},  {"$v0", 2},  {"$v1", 3},  {"$a0", 4},
     {"$a1", 5},   {"$a2", 6},  {"$a3", 7},  {"$t0", 8},  {"$t1", 9},
     {"$t2", 10},  {"$t3", 11}, {"$t4", 12}, {"$t5", 13}, {"$t6", 14},
@@ -44,4 +292,92 @@ const std::map<std::string, uint32_t> REGISTER_ABRV = {
     {"$t9", 25},  {"$k0", 26}, {"$k1", 27}, {"$gp", 28}, {"$sp", 29},
     {"$fp", 30},  {"$ra", 31}};
 
+// --------------------------------------------------------
+
+/**
+ * @brief Packs a name of up to 7 characters and its length into one integer,
+ * so two names can be compared with a single integer comparison.
+ *
+ * @return uint64_t the packed name, 0 if the name is empty or too long
+ */
+constexpr uint64_t packName(std::string_view s) {
+    if (s.empty() || s.size() > 7) return 0;
+    uint64_t key = static_cast<uint64_t>(s.size()) << 56;
+    for (size_t i = 0; i < s.size(); ++i) {
+        key |= static_cast<uint64_t>(static_cast<unsigned char>(s[i])) << (8 * i);
+    }
+    return key;
+}
+
+/**
+ * @brief Collision free hash table over the names of a definition table. The
+ * multiplier is searched at compile time, so a lookup is one multiplication
+ * and one comparison.
+ */
+template <size_t Bits>
+struct NameHash {
+    static constexpr size_t SIZE = size_t(1) << Bits;
+    uint64_t multiplier = 0;
+    uint64_t keys[SIZE] = {};
+    uint8_t values[SIZE] = {};  // index into the definition table
+
+    constexpr size_t slot(uint64_t key) const { return (key * multiplier) >> (64 - Bits); }
+
+    /**
+     * @return int index of name in the definition table, -1 if it is not there
+     */
+    constexpr int find(std::string_view name) const {
+        uint64_t key = packName(name);
+        size_t i = slot(key);
+        return (key != 0 && keys[i] == key) ? values[i] : -1;
+    }
+};
+
+template <size_t Bits, typename Def, size_t N>
+constexpr NameHash<Bits> makeNameHash(const Def (&defs)[N]) {
+    static_assert(N <= NameHash<Bits>::SIZE && N <= 256, "hash table too small");
+    for (uint64_t seed = 0x9E3779B97F4A7C15ull;; seed = seed * 6364136223846793005ull + 1442695040888963407ull) {
+        NameHash<Bits> hash;
+        hash.multiplier = seed | 1;
+        bool collision = false;
+        for (size_t i = 0; i < N && !collision; ++i) {
+            uint64_t key = packName(defs[i].name);
+            size_t s = hash.slot(key);
+            collision = hash.keys[s] != 0;
+            hash.keys[s] = key;
+            hash.values[s] = static_cast<uint8_t>(i);
+        }
+        if (!collision) return hash;
+    }
+}
+
+constexpr auto INSTR_HASH = makeNameHash<8>(INSTR_CODES);
+constexpr auto PSEUDO_HASH = makeNameHash<5>(PSEUDO_CODES);
+constexpr auto REGISTER_HASH = makeNameHash<7>(REGISTER_ABRV);
+
+/**
+ * @brief Looks up an instruction by its mnemonic.
+ *
+ * @return int INSTR_*, the index of the instruction in INSTR_CODES, -1 if the
+ * instruction is not supported
+ */
+inline int findInstruction(std::string_view name) { return INSTR_HASH.find(name); }
+
+/**
+ * @brief Looks up a pseudo-instruction by its mnemonic.
+ *
+ * @return int PSEUDO_*, -1 if it is no pseudo-instruction
+ */
+inline int findPseudo(std::string_view name) { return PSEUDO_HASH.find(name); }
+
+/**
+ * @brief Looks up the numerical index of a register abbreviation like "$t1".
+ *
+ * @return int register number, -1 if the abbreviation is not supported
+ */
+inline int findRegister(std::string_view name) {
+    int index = REGISTER_HASH.find(name);
+    return index < 0 ? -1 : static_cast<int>(REGISTER_ABRV[index].number);
+}
+
 #endif
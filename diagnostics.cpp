@@ -0,0 +1,70 @@
+#include "diagnostics.hpp"
+
+namespace {
+
+const char *severityName(int severity) { return severity == SEVERITY_WARNING ? "warning" : "error"; }
+
+void writeJsonString(std::ostream &out, const std::string &s) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    out << '"';
+    for (char c: s) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (u < 0x20) {
+            out << "\\u00" << HEX_DIGITS[u >> 4] << HEX_DIGITS[u & 0xF];
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+}  // namespace
+
+// --------------------------------------------------------
+
+void Diagnostics::report(size_t line, size_t column, int severity, std::string message) {
+    if (severity == SEVERITY_ERROR) ++errorCount_;
+    diagnostics_.push_back({line, column, severity, std::move(message)});
+}
+
+// --------------------------------------------------------
+
+void Diagnostics::append(const Diagnostics &other) {
+    errorCount_ += other.errorCount_;
+    diagnostics_.insert(diagnostics_.end(), other.diagnostics_.begin(), other.diagnostics_.end());
+}
+
+// --------------------------------------------------------
+
+void Diagnostics::writeText(std::ostream &out) const {
+    for (const auto &diagnostic: diagnostics_) {
+        out << file_ << ':';
+        if (diagnostic.line != 0) out << diagnostic.line << ':';
+        if (diagnostic.column != 0) out << diagnostic.column << ':';
+        out << ' ' << severityName(diagnostic.severity) << ": " << diagnostic.message << '\n';
+    }
+    if (limitReached()) {
+        out << file_ << ": too many errors, stopped after " << errorCount_ << '\n';
+    }
+}
+
+// --------------------------------------------------------
+
+void writeDiagnosticsJson(std::ostream &out, const std::vector<Diagnostics> &files) {
+    out << '[';
+    bool first = true;
+    for (const auto &file: files) {
+        for (const auto &diagnostic: file.all()) {
+            out << (first ? "\n" : ",\n") << "  {\"file\": ";
+            writeJsonString(out, file.file());
+            out << ", \"line\": " << diagnostic.line << ", \"column\": " << diagnostic.column
+                << ", \"severity\": \"" << severityName(diagnostic.severity) << "\", \"message\": ";
+            writeJsonString(out, diagnostic.message);
+            out << '}';
+            first = false;
+        }
+    }
+    out << (first ? "]\n" : "\n]\n");
+}
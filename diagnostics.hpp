@@ -0,0 +1,68 @@
+#ifndef MIPS_DIAGNOSTICS_H
+#define MIPS_DIAGNOSTICS_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum {
+    SEVERITY_WARNING,
+    SEVERITY_ERROR
+};
+
+struct Diagnostic {
+    size_t line = 0;    // 1-based, 0 if the problem is not bound to a line
+    size_t column = 0;  // 1-based, 0 if unknown
+    int severity = SEVERITY_ERROR;
+    std::string message;
+};
+
+/**
+ * @brief Collects the problems found in one source file, so assembling can
+ * go on after an error and all of them are reported at the end.
+ */
+class Diagnostics {
+   public:
+    /**
+     * @param file name of the source file used in the reports
+     * @param errorLimit number of errors after which assembling stops, 0 for
+     * no limit
+     */
+    explicit Diagnostics(std::string file = "", size_t errorLimit = 0)
+        : file_(std::move(file))
+        , errorLimit_(errorLimit) {}
+
+    void report(size_t line, size_t column, int severity, std::string message);
+
+    /**
+     * @brief Appends the diagnostics of another part of the same file.
+     */
+    void append(const Diagnostics &other);
+
+    const std::string &file() const { return file_; }
+    size_t errorLimit() const { return errorLimit_; }
+    size_t errorCount() const { return errorCount_; }
+    bool hasErrors() const { return errorCount_ != 0; }
+    bool limitReached() const { return errorLimit_ != 0 && errorCount_ >= errorLimit_; }
+    const std::vector<Diagnostic> &all() const { return diagnostics_; }
+
+    /**
+     * @brief Writes one "file:line:column: severity: message" line per
+     * diagnostic.
+     */
+    void writeText(std::ostream &out) const;
+
+   private:
+    std::string file_;
+    size_t errorLimit_;
+    size_t errorCount_ = 0;
+    std::vector<Diagnostic> diagnostics_;
+};
+
+/**
+ * @brief Writes the diagnostics of several files as one JSON array of objects
+ * with the members file, line, column, severity and message.
+ */
+void writeDiagnosticsJson(std::ostream &out, const std::vector<Diagnostics> &files);
+
+#endif
@@ -0,0 +1,258 @@
+#include "directives.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+#include "assembler.hpp"
+#include "macros.hpp"
+#include "symbols.hpp"
+
+namespace {
+
+// names of the directives, in the order of DIRECTIVE_*
+constexpr std::string_view DIRECTIVE_NAMES[DIRECTIVE_COUNT] = {".text",  ".data",  ".word",  ".byte",
+                                                               ".space", ".align", ".incbin"};
+
+bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && isBlank(s.front())) s.remove_prefix(1);
+    while (!s.empty() && isBlank(s.back())) s.remove_suffix(1);
+    return s;
+}
+
+/**
+ * @brief Number of the comma separated operands, 0 if there are none.
+ */
+size_t countOperands(std::string_view text) {
+    return text.empty() ? 0 : std::count(text.begin(), text.end(), ',') + 1;
+}
+
+/**
+ * @brief Gets the next of the comma separated operands.
+ *
+ * @param pos offset of the operand in text, moved behind its comma
+ * @throws AssemblerError if the operand is empty
+ */
+std::string_view nextOperand(std::string_view text, size_t &pos) {
+    size_t comma = text.find(',', pos);
+    std::string_view operand = trim(text.substr(pos, comma == std::string_view::npos ? comma : comma - pos));
+    if (operand.empty()) throw AssemblerError("Missing argument.");
+    pos = comma == std::string_view::npos ? text.size() : comma + 1;
+    return operand;
+}
+
+/**
+ * @brief Reads an operand that has to be a whole number.
+ *
+ * @return bool false, if the operand is no number or out of [min, max]
+ */
+bool readOperand(std::string_view operand, long long min, long long max, long long &value) {
+    return readNumber(operand, value) == operand.size() && value >= min && value <= max;
+}
+
+/**
+ * @brief Path of ".incbin", the quotes are optional.
+ */
+std::string incbinPath(std::string_view operands) {
+    if (operands.size() >= 2 && operands.front() == '"' && operands.back() == '"') {
+        operands = operands.substr(1, operands.size() - 2);
+    }
+    return std::string(operands);
+}
+
+/**
+ * @brief Alignment of the data of a directive in bytes, 1 if the operands of
+ * ".align" are invalid.
+ */
+uint32_t dataAlignment(int directive, std::string_view operands) {
+    long long power;
+    if (directive == DIRECTIVE_WORD) return 4;
+    if (directive == DIRECTIVE_ALIGN && readOperand(operands, 0, MAX_DATA_ALIGNMENT, power)) return 1u << power;
+    return 1;
+}
+
+/**
+ * @brief Bytes of the data of a directive after its alignment, 0 if the
+ * operands are invalid.
+ */
+uint64_t dataSize(int directive, std::string_view operands, IncbinSizes &incbinSizes) {
+    long long value;
+    switch (directive) {
+        case DIRECTIVE_WORD:
+            return 4 * countOperands(operands);
+        case DIRECTIVE_BYTE:
+            return countOperands(operands);
+        case DIRECTIVE_SPACE:
+            return readOperand(operands, 0, UINT32_MAX, value) ? value : 0;
+        case DIRECTIVE_INCBIN:
+            value = incbinSizes.size(incbinSizes.resolve(incbinPath(operands)));
+            return value > 0 ? static_cast<uint64_t>(value) : 0;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Appends the bytes of a data directive, see assembleData.
+ */
+void emitData(int directive, std::string_view operands, std::vector<uint8_t> &data, IncbinSizes &incbinSizes) {
+    long long value;
+    size_t pos = 0;
+    switch (directive) {
+        case DIRECTIVE_WORD:
+        case DIRECTIVE_BYTE:
+            if (operands.empty()) throw AssemblerError("Missing argument.");
+            while (pos < operands.size()) {
+                std::string_view operand = nextOperand(operands, pos);
+                if (readNumber(operand, value) != operand.size()) {
+                    throw AssemblerError("Invalid number.", std::string(operand));
+                }
+                if (directive == DIRECTIVE_BYTE) {
+                    if (value < INT8_MIN || value > UINT8_MAX) throw AssemblerError("Argument too long.", std::string(operand));
+                    data.push_back(static_cast<uint8_t>(value));
+                    continue;
+                }
+                if (value < INT32_MIN || value > UINT32_MAX) throw AssemblerError("Argument too long.", std::string(operand));
+                for (int shift = 0; shift < 32; shift += 8) data.push_back(static_cast<uint8_t>(value >> shift));
+            }
+            if (operands.back() == ',') throw AssemblerError("Missing argument.");
+            break;
+        case DIRECTIVE_SPACE:
+            if (!readOperand(operands, 0, UINT32_MAX, value)) {
+                throw AssemblerError("Invalid number.", std::string(operands));
+            }
+            if (static_cast<uint64_t>(value) > MAX_DATA_SIZE - data.size()) {
+                throw AssemblerError("Data segment too large.", std::string(operands));
+            }
+            data.resize(data.size() + value);
+            break;
+        case DIRECTIVE_ALIGN:
+            if (!readOperand(operands, 0, MAX_DATA_ALIGNMENT, value)) {
+                throw AssemblerError("Invalid alignment.", std::string(operands));
+            }
+            break;  // the padding is added like for every directive
+        case DIRECTIVE_INCBIN: {
+            std::string path = incbinSizes.resolve(incbinPath(operands));
+            long long counted = incbinSizes.size(path);
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            std::streamoff size = file ? static_cast<std::streamoff>(file.tellg()) : -1;
+            if (size < 0) throw AssemblerError("Can't read " + path + ".", std::string(operands));
+            if (static_cast<uint64_t>(size) > MAX_DATA_SIZE - data.size()) {
+                throw AssemblerError("Data segment too large.", std::string(operands));
+            }
+            if (size != counted) {
+                throw AssemblerError("File " + path + " changed while it was assembled.", std::string(operands));
+            }
+            // one read straight into the segment, the file is never split into lines
+            size_t address = data.size();
+            data.resize(address + static_cast<size_t>(size));
+            file.seekg(0);
+            if (!file.read(reinterpret_cast<char *>(data.data() + address), size)) {
+                throw AssemblerError("Can't read " + path + ".", std::string(operands));
+            }
+            break;
+        }
+    }
+}
+
+}  // namespace
+
+// --------------------------------------------------------
+
+IncbinSizes::IncbinSizes(std::string_view source) {
+    size_t slash = source.rfind('/');
+    if (slash != std::string_view::npos) directory_ = source.substr(0, slash + 1);
+}
+
+// --------------------------------------------------------
+
+std::string IncbinSizes::resolve(std::string_view path) const {
+    if (directory_.empty() || path.empty() || path[0] == '/') return std::string(path);
+    return directory_ + std::string(path);
+}
+
+// --------------------------------------------------------
+
+long long IncbinSizes::size(const std::string &path) {
+    auto [entry, inserted] = sizes_.try_emplace(path, -1);
+    if (!inserted) return entry->second;
+    std::ifstream file(entry->first, std::ios::binary | std::ios::ate);
+    std::streamoff size = file ? static_cast<std::streamoff>(file.tellg()) : -1;
+    if (size > static_cast<std::streamoff>(MAX_DATA_SIZE)) size = MAX_DATA_SIZE + 1;
+    entry->second = size;
+    return size;
+}
+
+// --------------------------------------------------------
+
+int findDirective(std::string_view mnemonic) {
+    if (mnemonic.empty() || mnemonic[0] != '.') return -1;
+    for (int i = 0; i < DIRECTIVE_COUNT; ++i) {
+        if (DIRECTIVE_NAMES[i] == mnemonic) return i;
+    }
+    return -1;
+}
+
+// --------------------------------------------------------
+
+uint32_t countData(const LineTokens &tokens,
+                   std::string_view line,
+                   int &segment,
+                   uint32_t &address,
+                   IncbinSizes &incbinSizes) {
+    int directive = findDirective(tokens.mnemonic);
+    if (directive == DIRECTIVE_TEXT || directive == DIRECTIVE_DATA) {
+        segment = directive == DIRECTIVE_TEXT ? SEGMENT_TEXT : SEGMENT_DATA;
+        return address;
+    }
+    if (segment != SEGMENT_DATA) return address;
+
+    std::string_view operands = operandText(tokens, line);
+    uint32_t alignment = dataAlignment(directive, operands);
+    uint64_t start = (uint64_t(address) + alignment - 1) & ~uint64_t(alignment - 1);
+    uint64_t end = start + dataSize(directive, operands, incbinSizes);
+    if (end > MAX_DATA_SIZE) return address;  // too large, an error of assembleData
+    address = static_cast<uint32_t>(end);
+    return static_cast<uint32_t>(start);
+}
+
+// --------------------------------------------------------
+
+uint32_t assembleData(const LineTokens &tokens,
+                      std::string_view line,
+                      int &segment,
+                      std::vector<uint8_t> &data,
+                      IncbinSizes &incbinSizes) {
+    int line_segment = segment;
+    uint32_t address = static_cast<uint32_t>(data.size());
+    uint32_t start = countData(tokens, line, segment, address, incbinSizes);
+    int directive = findDirective(tokens.mnemonic);
+    std::string_view operands = operandText(tokens, line);
+    try {
+        if (directive == DIRECTIVE_TEXT || directive == DIRECTIVE_DATA) {
+            if (!operands.empty()) throw AssemblerError("Wrong amount of arguments for directive " + std::string(tokens.mnemonic) + ".");
+            return start;
+        }
+        if (line_segment != SEGMENT_DATA) {
+            throw AssemblerError("Directive " + std::string(tokens.mnemonic) + " outside of .data.", std::string(tokens.mnemonic));
+        }
+        if (tokens.mnemonic.empty()) return start;  // a label of the data
+        if (directive < 0) {
+            throw AssemblerError(tokens.mnemonic[0] == '.' ? "Directive " + std::string(tokens.mnemonic) + " is not supported."
+                                                           : std::string("Instruction in the data segment."),
+                                 std::string(tokens.mnemonic));
+        }
+
+        data.resize(start);
+        emitData(directive, operands, data, incbinSizes);
+        if (data.size() > MAX_DATA_SIZE) throw AssemblerError("Data segment too large.", std::string(operands));
+        return start;
+    } catch (const AssemblerError &) {
+        // the following labels keep the addresses of the first pass
+        data.resize(address);
+        throw;
+    }
+}
+
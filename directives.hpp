@@ -0,0 +1,134 @@
+#ifndef MIPS_DIRECTIVES_H
+#define MIPS_DIRECTIVES_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "lexer.hpp"
+#include "symbols.hpp"
+
+// directives of the segments
+enum {
+    DIRECTIVE_TEXT,    // ".text", the following lines are instructions
+    DIRECTIVE_DATA,    // ".data", the following lines are data
+    DIRECTIVE_WORD,    // ".word n, ...", 32 bit numbers aligned to 4 bytes
+    DIRECTIVE_BYTE,    // ".byte n, ...", 8 bit numbers
+    DIRECTIVE_SPACE,   // ".space n", n zero bytes
+    DIRECTIVE_ALIGN,   // ".align n", zero bytes up to a multiple of 2^n
+    DIRECTIVE_INCBIN,  // ".incbin \"file\"", the bytes of a file
+    DIRECTIVE_COUNT
+};
+
+// largest data segment in bytes
+constexpr uint32_t MAX_DATA_SIZE = 1u << 30;
+
+// largest n of ".align n", the linker places the data of each object at a
+// multiple of 2^n bytes
+constexpr long long MAX_DATA_ALIGNMENT = 4;
+
+/**
+ * @brief Sizes of the files of ".incbin" by path. The pass that counts the
+ * data takes the size of each file once, assembleData reads the file with
+ * it, so a file that changes between the passes is an error instead of
+ * moving the labels behind it. Relative paths are resolved against the
+ * directory of the source that includes the files.
+ */
+class IncbinSizes {
+   public:
+    /**
+     * @param source path of the source, empty or without directory for the
+     * working directory
+     */
+    explicit IncbinSizes(std::string_view source = {});
+
+    /**
+     * @return std::string path of a file of ".incbin" as it is opened
+     */
+    std::string resolve(std::string_view path) const;
+
+    /**
+     * @param path path returned by resolve
+     * @return long long size of the file, measured at the first call for the
+     * path, -1 if it can't be read. Sizes above MAX_DATA_SIZE are cut to
+     * MAX_DATA_SIZE + 1.
+     */
+    long long size(const std::string &path);
+
+    void clear() { sizes_.clear(); }
+
+   private:
+    std::string directory_;  // with a trailing '/', empty for the working directory
+    std::unordered_map<std::string, long long> sizes_;
+};
+
+/**
+ * @return int DIRECTIVE_*, -1 if the mnemonic is no directive of the
+ * segments
+ */
+int findDirective(std::string_view mnemonic);
+
+/**
+ * @brief Follows the segments and counts the data of a line for the passes
+ * that only count. The line must have a directive or be in the data segment.
+ * Errors are left to assembleData, which makes a line with an error take the
+ * bytes counted here.
+ *
+ * @param tokens tokens of the line
+ * @param line the source line
+ * @param segment SEGMENT_* of the line, receives the one of the next line
+ * @param address address in the data segment, moved behind the line
+ * @param incbinSizes sizes of the files of ".incbin", receives the ones that
+ * are measured first
+ * @return uint32_t address of the data of the line after its alignment
+ */
+uint32_t countData(const LineTokens &tokens,
+                   std::string_view line,
+                   int &segment,
+                   uint32_t &address,
+                   IncbinSizes &incbinSizes);
+
+/**
+ * @brief Assembles a line that has a directive or is in the data segment.
+ * The bytes of ".incbin" are read from the file straight into the data
+ * segment, see IncbinSizes for relative paths.
+ *
+ * @param tokens tokens of the line
+ * @param line the source line
+ * @param segment SEGMENT_* of the line, receives the one of the next line
+ * @param data the data segment, its size is the address of the line. The
+ * bytes of the line are appended, as many as countData counted if the line
+ * has an error.
+ * @param incbinSizes sizes of the files of ".incbin", see countData
+ * @return uint32_t address of the data of the line after its alignment
+ * @throws AssemblerError if the line is an instruction in the data segment,
+ * data in the text segment, has invalid operands or its file of ".incbin"
+ * changed its size since it was counted
+ */
+uint32_t assembleData(const LineTokens &tokens,
+                      std::string_view line,
+                      int &segment,
+                      std::vector<uint8_t> &data,
+                      IncbinSizes &incbinSizes);
+
+/**
+ * @return size_t number of words of the data segment, the last one is padded
+ * with zeros
+ */
+inline size_t dataWordCount(const std::vector<uint8_t> &data) { return (data.size() + 3) / 4; }
+
+/**
+ * @brief Word of the data segment as the data memory of the simulator holds
+ * it, little endian and padded with zeros behind the last byte.
+ *
+ * @param index index of the word, less than dataWordCount
+ */
+inline uint32_t dataWord(const std::vector<uint8_t> &data, size_t index) {
+    uint32_t word = 0;
+    for (size_t i = 4 * index; i < data.size() && i < 4 * index + 4; ++i) word |= uint32_t(data[i]) << (8 * (i % 4));
+    return word;
+}
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef MIPS_INSTRUCTION_H
+#define MIPS_INSTRUCTION_H
+
+#include <cstdint>
+#include <vector>
+
+#include "definitions.hpp"
+
+// label of an Instruction that refers to no label
+constexpr uint32_t NO_LABEL = ~0u;
+
+/**
+ * @brief Parsed instruction as handed from the parser to the encoder. The
+ * record is plain data of a fixed size, so all instructions of a source are
+ * kept in one contiguous array.
+ */
+struct Instruction {
+    uint8_t opcode = INSTR_NOP;  // INSTR_*, index into INSTR_CODES
+    uint8_t rd = 0;
+    uint8_t rs = 0;
+    uint8_t rt = 0;
+    int32_t immediate = 0;      // immediate, offset, shift amount or jump target
+    uint32_t label = NO_LABEL;  // index of the name of the referenced label
+    uint32_t line = 0;          // number of the source line, starting at 1
+};
+
+/**
+ * @brief Encoder of one layout. The layout is a template parameter, so each
+ * one compiles to a few shifts and ors without branches.
+ */
+template <int Format>
+constexpr uint32_t encodeFormat(const InstructionCodes &codes, const Instruction &instruction) {
+    uint32_t immediate = static_cast<uint32_t>(instruction.immediate);
+    uint32_t op_code = codes.op_code << 26;
+    if constexpr (Format == INSTR_TYPE_R) {
+        // the shift amount is in the immediate, it is 0 for the others
+        return op_code | uint32_t(instruction.rs) << 21 | uint32_t(instruction.rt) << 16 |
+               uint32_t(instruction.rd) << 11 | (immediate & 0x1F) << 6 | codes.function;
+    } else if constexpr (Format == INSTR_TYPE_I) {
+        // REGIMM branches have their code in rt
+        return op_code | uint32_t(instruction.rs) << 21 | (uint32_t(instruction.rt) | codes.function) << 16 |
+               (immediate & 0xFFFF);
+    } else if constexpr (Format == INSTR_TYPE_J) {
+        return op_code | (immediate & 0x3FFFFFF);
+    } else if constexpr (Format == INSTR_TYPE_EXIT) {
+        return ~0u;
+    } else {
+        return 0u;
+    }
+}
+
+/**
+ * @brief Converts a parsed instruction into its binary form. The fields have
+ * to be checked by the parser, so encoding can't fail.
+ *
+ * @return uint32_t binary MIPS instruction
+ */
+constexpr uint32_t encodeInstruction(const Instruction &instruction) {
+    const InstructionCodes &codes = INSTR_CODES[instruction.opcode].codes;
+    switch (codes.format) {
+        case INSTR_TYPE_R:
+            return encodeFormat<INSTR_TYPE_R>(codes, instruction);
+        case INSTR_TYPE_I:
+            return encodeFormat<INSTR_TYPE_I>(codes, instruction);
+        case INSTR_TYPE_J:
+            return encodeFormat<INSTR_TYPE_J>(codes, instruction);
+        case INSTR_TYPE_EXIT:
+            return encodeFormat<INSTR_TYPE_EXIT>(codes, instruction);
+        case INSTR_TYPE_NULL:
+        default:
+            return encodeFormat<INSTR_TYPE_NULL>(codes, instruction);
+    }
+}
+
+// no instruction in a DecodeTables entry
+constexpr uint8_t DECODE_NONE = 0xFF;
+
+/**
+ * @brief Index into INSTR_CODES of each binary instruction, looked up by the
+ * op code and for some op codes by the function or rt.
+ */
+struct DecodeTables {
+    uint8_t byOpCode[64] = {};
+    uint8_t bySpecial[64] = {};   // function of OP_SPECIAL
+    uint8_t bySpecial2[64] = {};  // function of OP_SPECIAL2
+    uint8_t byRegimm[32] = {};    // rt of OP_REGIMM
+};
+
+constexpr DecodeTables makeDecodeTables() {
+    DecodeTables tables;
+    for (auto &entry: tables.byOpCode) entry = DECODE_NONE;
+    for (auto &entry: tables.bySpecial) entry = DECODE_NONE;
+    for (auto &entry: tables.bySpecial2) entry = DECODE_NONE;
+    for (auto &entry: tables.byRegimm) entry = DECODE_NONE;
+    for (size_t i = 0; i < INSTR_COUNT; ++i) {
+        const InstructionCodes &codes = INSTR_CODES[i].codes;
+        if (codes.format == INSTR_TYPE_NULL || codes.format == INSTR_TYPE_EXIT) continue;
+        if (codes.format == INSTR_TYPE_R && codes.op_code == OP_SPECIAL) {
+            tables.bySpecial[codes.function] = static_cast<uint8_t>(i);
+        } else if (codes.format == INSTR_TYPE_R && codes.op_code == OP_SPECIAL2) {
+            tables.bySpecial2[codes.function] = static_cast<uint8_t>(i);
+        } else if (codes.op_code == OP_REGIMM) {
+            tables.byRegimm[codes.function] = static_cast<uint8_t>(i);
+        } else {
+            tables.byOpCode[codes.op_code] = static_cast<uint8_t>(i);
+        }
+    }
+    return tables;
+}
+
+constexpr DecodeTables DECODE_TABLES = makeDecodeTables();
+
+/**
+ * @brief Converts a binary instruction back into its parsed form. The
+ * immediate of I type instructions is sign extended.
+ *
+ * @param word binary MIPS instruction
+ * @param instruction receives the instruction
+ * @return true, if word is one of the supported instructions
+ */
+constexpr bool decodeInstruction(uint32_t word, Instruction &instruction) {
+    instruction = Instruction{};
+    if (word == ~0u) {
+        instruction.opcode = INSTR_EXIT;
+        return true;
+    }
+    if (word == 0) return true;  // nop
+
+    uint32_t op_code = word >> 26;
+    uint32_t function = word & 0x3F;
+    uint32_t rt = (word >> 16) & 0x1F;
+    uint8_t index = op_code == OP_SPECIAL    ? DECODE_TABLES.bySpecial[function]
+                    : op_code == OP_SPECIAL2 ? DECODE_TABLES.bySpecial2[function]
+                    : op_code == OP_REGIMM   ? DECODE_TABLES.byRegimm[rt]
+                                             : DECODE_TABLES.byOpCode[op_code];
+    if (index == DECODE_NONE) return false;
+
+    uint32_t format = INSTR_CODES[index].codes.format;
+    instruction.opcode = index;
+    instruction.rs = (word >> 21) & 0x1F;
+    instruction.rt = op_code == OP_REGIMM ? 0 : rt;
+    instruction.rd = (word >> 11) & 0x1F;
+    if (format == INSTR_TYPE_R) instruction.immediate = (word >> 6) & 0x1F;
+    if (format == INSTR_TYPE_I) instruction.immediate = static_cast<int16_t>(word & 0xFFFF);
+    if (format == INSTR_TYPE_J) instruction.immediate = word & 0x3FFFFFF;
+    return true;
+}
+
+/**
+ * @brief Tells whether every instruction decodes to itself, so no two lines
+ * of INSTR_CODES have the same codes.
+ */
+constexpr bool decodesAllInstructions() {
+    for (size_t i = 0; i < INSTR_COUNT; ++i) {
+        Instruction instruction;
+        instruction.opcode = static_cast<uint8_t>(i);
+        instruction.rs = 1;  // some word other than nop
+        instruction.rd = 1;
+        Instruction decoded;
+        if (!decodeInstruction(encodeInstruction(instruction), decoded) || decoded.opcode != i) return false;
+    }
+    return true;
+}
+
+static_assert(decodesAllInstructions(), "codes of INSTR_CODES are not unique");
+
+/**
+ * @brief Appends the binary form of all instructions to words.
+ */
+inline void encodeInstructions(const std::vector<Instruction> &instructions, std::vector<uint32_t> &words) {
+    size_t first = words.size();
+    words.resize(first + instructions.size());
+    uint32_t *out = words.data() + first;
+    for (const Instruction &instruction: instructions) *out++ = encodeInstruction(instruction);
+}
+
+/**
+ * @brief Tells whether an instruction that takes a label encodes the address
+ * of the label. Branches encode the distance to it instead, which stays the
+ * same wherever the code is placed.
+ *
+ * @param opcode INSTR_* of an instruction that takes a label
+ */
+constexpr bool takesAddress(int opcode) {
+    return opcode == INSTR_LUI || opcode == INSTR_ORI || INSTR_CODES[opcode].codes.format == INSTR_TYPE_J;
+}
+
+/**
+ * @brief Target of a jump, offset of a branch or half of the address for a
+ * label.
+ *
+ * @param opcode INSTR_* of an instruction that takes a label
+ * @param label_address address of the label
+ * @param instruction_count address of the instruction
+ */
+constexpr int labelTarget(int opcode, int label_address, int instruction_count) {
+    // the halves of "lui rt, %hi(label)" and "ori rt, rs, %lo(label)"
+    if (opcode == INSTR_LUI) return static_cast<int>(static_cast<uint32_t>(label_address) >> 16);
+    if (opcode == INSTR_ORI) return label_address & 0xFFFF;
+    return INSTR_CODES[opcode].codes.format == INSTR_TYPE_J ? label_address / 4
+                                                             : (label_address - instruction_count - 4) / 4;
+}
+
+#endif
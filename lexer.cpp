@@ -0,0 +1,194 @@
+#include "lexer.hpp"
+
+#include "definitions.hpp"
+
+namespace {
+
+bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+/**
+ * @brief Matches "offset(base)" where offset is an optionally negative decimal
+ * number and base is not empty.
+ *
+ * @param s token to match
+ * @param offset receives the offset including a leading '-'
+ * @param base receives the text between the parentheses
+ * @return true, if s has the form of a memory operand
+ */
+bool matchMemoryOperand(std::string_view s, std::string_view &offset, std::string_view &base) {
+    size_t pos = (!s.empty() && s[0] == '-') ? 1 : 0;
+    size_t digits_begin = pos;
+    while (pos < s.size() && isDigit(s[pos])) ++pos;
+    if (pos == digits_begin || pos >= s.size() || s[pos] != '(') return false;
+    if (s.size() - pos < 3 || s.back() != ')') return false;
+
+    offset = s.substr(0, pos);
+    base = s.substr(pos + 1, s.size() - pos - 2);
+    return true;
+}
+
+/**
+ * @brief Matches the operands of "instr a, b, c" that were split at blanks
+ * into two parts, e.g. "a," and "b,c". Tries the longest first operand first.
+ */
+bool matchThreeOperands(std::string_view a, std::string_view b, std::string_view (&operands)[3]) {
+    if (a.size() >= 2 && b.size() >= 3) {
+        size_t comma = b.rfind(',', b.size() - 2);
+        if (comma != std::string_view::npos && comma > 0) {
+            operands[0] = a.substr(0, a.size() - 1);
+            operands[1] = b.substr(0, comma);
+            operands[2] = b.substr(comma + 1);
+            return true;
+        }
+    }
+
+    if (a.size() >= 4) {
+        size_t comma = a.rfind(',', a.size() - 3);
+        if (comma != std::string_view::npos && comma > 0) {
+            operands[0] = a.substr(0, comma);
+            operands[1] = a.substr(comma + 1, a.size() - comma - 2);
+            operands[2] = b;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Tells whether an instruction takes two operands. Other instructions
+ * don't get LINE_SHAPE_PAIR, so such lines stay invalid.
+ */
+bool takesPair(std::string_view mnemonic) {
+    int opcode = findInstruction(mnemonic);
+    return opcode >= 0 && instructionSyntax(opcode).partCount == 3;
+}
+
+/**
+ * @brief Matches "a,b" with both operands not empty.
+ */
+bool matchPair(std::string_view s, std::string_view (&operands)[3]) {
+    size_t comma = s.find(',');
+    if (comma == std::string_view::npos || comma == 0 || comma + 1 == s.size()) return false;
+    if (s.find(',', comma + 1) != std::string_view::npos) return false;
+    operands[0] = s.substr(0, comma);
+    operands[1] = s.substr(comma + 1);
+    return true;
+}
+
+}  // namespace
+
+// --------------------------------------------------------
+
+LineTokens lexLine(std::string_view line) {
+    LineTokens tokens;
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+
+    // the comment starts at the last '#', the code ends before the first one
+    size_t comment_pos = line.rfind('#');
+    if (comment_pos != std::string_view::npos) tokens.comment = line.substr(comment_pos);
+
+    size_t pos = 0;
+    while (pos < line.size() && isBlank(line[pos])) ++pos;
+    if (pos == line.size() || line[pos] == '#') return tokens;
+    tokens.hasCode = true;
+
+    std::string_view code = line.substr(0, line.find('#'));
+
+    // split into blank separated words; the label is the first word that
+    // contains a ':' and everything up to the last ':' of a word is dropped
+    std::string_view words[5];
+    size_t word_cnt = 0;
+    while (pos < code.size()) {
+        size_t end = pos;
+        while (end < code.size() && !isBlank(code[end])) ++end;
+        std::string_view word = code.substr(pos, end - pos);
+
+        size_t colon = word.rfind(':');
+        if (colon != std::string_view::npos) {
+            if (tokens.label.empty()) {
+                tokens.label = word.substr(0, colon + 1);
+                tokens.labelSingle = true;
+                for (size_t i = code.find(':') + 1; i < code.size(); ++i) {
+                    if (!isBlank(code[i])) {
+                        tokens.labelSingle = false;
+                        break;
+                    }
+                }
+            }
+            word.remove_prefix(colon + 1);
+        }
+        if (!word.empty()) {
+            if (word_cnt < 5) words[word_cnt] = word;
+            ++word_cnt;
+        }
+
+        pos = end;
+        while (pos < code.size() && isBlank(code[pos])) ++pos;
+    }
+
+    if (word_cnt == 0) return tokens;
+    tokens.mnemonic = words[0];
+    tokens.shape = LINE_SHAPE_INVALID;
+    if (word_cnt > 4) return tokens;
+
+    std::string_view *operands = tokens.operands;
+    switch (word_cnt) {
+        case 1:
+            tokens.shape = LINE_SHAPE_ONE;
+            break;
+
+        case 2:
+            if (takesPair(words[0]) && matchPair(words[1], tokens.operands)) {
+                tokens.shape = LINE_SHAPE_PAIR;
+                break;
+            }
+            operands[0] = words[1];
+            tokens.shape = LINE_SHAPE_TWO;
+            break;
+
+        case 3:
+            if (words[1].size() < 2 || words[1].back() != ',') break;
+            if (matchMemoryOperand(words[2], operands[1], operands[2])) {
+                operands[0] = words[1].substr(0, words[1].size() - 1);
+                tokens.shape = LINE_SHAPE_OFFSET;
+            } else if (matchThreeOperands(words[1], words[2], tokens.operands)) {
+                tokens.shape = LINE_SHAPE_THREE;
+            } else if (takesPair(words[0]) && words[2].find(',') == std::string_view::npos) {
+                operands[0] = words[1].substr(0, words[1].size() - 1);
+                operands[1] = words[2];
+                tokens.shape = LINE_SHAPE_PAIR;
+            }
+            break;
+
+        case 4:
+            if (words[1].size() < 2 || words[1].back() != ',') break;
+            if (words[2].size() < 2 || words[2].back() != ',') break;
+            operands[0] = words[1].substr(0, words[1].size() - 1);
+            operands[1] = words[2].substr(0, words[2].size() - 1);
+            operands[2] = words[3];
+            tokens.shape = LINE_SHAPE_THREE;
+            break;
+    }
+    return tokens;
+}
+
+// --------------------------------------------------------
+
+size_t readNumber(std::string_view s, long long &value) {
+    size_t pos = 0;
+    bool negative = false;
+    if (pos < s.size() && (s[pos] == '+' || s[pos] == '-')) negative = s[pos++] == '-';
+
+    size_t first_digit = pos;
+    value = 0;
+    for (; pos < s.size() && s[pos] >= '0' && s[pos] <= '9'; ++pos) {
+        if (value < (1ll << 40)) value = value * 10 + (s[pos] - '0');
+    }
+    if (pos == first_digit) return 0;
+    if (negative) value = -value;
+    return pos;
+}
@@ -0,0 +1,58 @@
+#ifndef MIPS_LEXER_H
+#define MIPS_LEXER_H
+
+#include <cstddef>
+#include <string_view>
+
+// operand layouts a source line can have
+enum {
+    LINE_SHAPE_NONE,     // no instruction on the line
+    LINE_SHAPE_ONE,      // "instr"
+    LINE_SHAPE_TWO,      // "instr arg"
+    LINE_SHAPE_OFFSET,   // "instr arg, offset(base)"
+    LINE_SHAPE_THREE,    // "instr arg, arg, arg"
+    LINE_SHAPE_PAIR,     // "instr arg, arg", only for instructions with two operands
+    LINE_SHAPE_INVALID   // code that matches none of the layouts above
+};
+
+/**
+ * @brief Tokens of a single source line. All members are views into the line
+ * that was passed to lexLine, so they are only valid as long as that buffer.
+ */
+struct LineTokens {
+    std::string_view label;        // label including the trailing ':'
+    std::string_view comment;      // comment starting with '#'
+    std::string_view mnemonic;     // first word of the code, empty if there is none
+    std::string_view operands[3];  // "lw $t1, 4($t2)" -> {"$t1", "4", "$t2"}
+    int shape = LINE_SHAPE_NONE;
+    bool hasCode = false;      // the first non-blank character is not a '#'
+    bool labelSingle = false;  // the label is the only code on the line
+
+    /**
+     * @brief Name of the label without the trailing ':'.
+     */
+    std::string_view labelName() const {
+        return label.empty() ? label : label.substr(0, label.size() - 1);
+    }
+};
+
+/**
+ * @brief Splits a source line into label, mnemonic, operands and comment by
+ * walking over it once.
+ *
+ * @param line a single line without the line break
+ * @return LineTokens views into line
+ */
+LineTokens lexLine(std::string_view line);
+
+/**
+ * @brief Reads the decimal number at the start of a string like strtol.
+ *
+ * @param s string starting with an optional sign and digits
+ * @param value receives the number, 0 if there is none. Numbers that don't
+ * fit into 32 bits are clamped to a value that doesn't fit either.
+ * @return size_t number of characters read, 0 if s doesn't start with a number
+ */
+size_t readNumber(std::string_view s, long long &value);
+
+#endif
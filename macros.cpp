@@ -0,0 +1,371 @@
+#include "macros.hpp"
+
+#include <cstdio>
+#include <initializer_list>
+
+#include "assembler.hpp"
+#include "definitions.hpp"
+
+namespace {
+
+bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && isBlank(s.front())) s.remove_prefix(1);
+    while (!s.empty() && isBlank(s.back())) s.remove_suffix(1);
+    return s;
+}
+
+/**
+ * @brief Matches "offset(base)" with any offset, so parameters can be
+ * replaced in both.
+ */
+bool splitMemoryOperand(std::string_view s, std::string_view &offset, std::string_view &base) {
+    size_t open = s.find('(');
+    if (open == std::string_view::npos || s.size() - open < 3 || s.back() != ')') return false;
+    offset = trim(s.substr(0, open));
+    base = trim(s.substr(open + 1, s.size() - open - 2));
+    return true;
+}
+
+/**
+ * @brief Copies a number into the text of an expansion.
+ */
+std::string_view numberText(Expansion &expansion, long long value) {
+    char text[24];
+    int size = std::snprintf(text, sizeof(text), "%lld", value);
+    return expansion.numbers.copy(std::string_view(text, size));
+}
+
+/**
+ * @brief Appends an instruction to an expansion.
+ */
+void emit(Expansion &expansion,
+          std::string_view mnemonic,
+          std::initializer_list<std::string_view> operands,
+          int syntax = -1) {
+    ExpandedInstruction instruction;
+    instruction.parts[0] = mnemonic;
+    for (std::string_view operand: operands) instruction.parts[++instruction.partCount] = operand;
+    ++instruction.partCount;
+    instruction.syntax = syntax;
+    expansion.instructions.push_back(instruction);
+}
+
+/**
+ * @brief Expands a load or store whose offset is a label, "lw rt, label" or
+ * "lw rt, label(base)", into the two words of "la $at, label", an "addu" of
+ * the base unless it is $zero, and the access at offset 0 of $at.
+ *
+ * @param base empty for "lw rt, label"
+ * @return false, if the instruction is no load or store or its offset is no
+ * label
+ */
+bool expandMemoryLabel(std::string_view mnemonic,
+                       std::string_view rt,
+                       std::string_view offset,
+                       std::string_view base,
+                       Expansion &expansion) {
+    long long value;
+    if (offset.empty() || readNumber(offset, value) != 0 || offset.find_first_of("()") != std::string_view::npos) {
+        return false;
+    }
+    int opcode = findInstruction(mnemonic);
+    if (opcode < 0 || INSTR_CODES[opcode].syntax != SYNTAX_RT_OFFSET_BASE) return false;
+    emit(expansion, "lui", {"$at", offset}, SYNTAX_RT_HI);
+    emit(expansion, "ori", {"$at", "$at", offset}, SYNTAX_RT_RS_LO);
+    if (!base.empty() && base != "$zero" && base != "$0") emit(expansion, "addu", {"$at", "$at", base});
+    emit(expansion, mnemonic, {rt, "$at", "0"});
+    return true;
+}
+
+/**
+ * @brief Expands a pseudo-instruction, see PSEUDO_CODES.
+ *
+ * @throws AssemblerError if the number of operands or the immediate of "li"
+ * is invalid
+ */
+void expandPseudo(int pseudo, const std::string_view *operands, size_t operand_cnt, Expansion &expansion) {
+    const PseudoDef &def = PSEUDO_CODES[pseudo];
+    if (operand_cnt != def.operandCount) {
+        throw AssemblerError(std::string("Wrong amount of arguments for pseudo-instruction ") + std::string(def.name) +
+                             ": " + std::to_string(operand_cnt) + ".");
+    }
+
+    const std::string_view *a = operands;
+    switch (pseudo) {
+        case PSEUDO_LI: {
+            long long value;
+            if (readNumber(a[1], value) != a[1].size() || value < INT32_MIN || value > UINT32_MAX) {
+                throw AssemblerError("Invalid number.", std::string(a[1]));
+            }
+            // the shortest sequence, it only depends on the number
+            uint32_t word = static_cast<uint32_t>(value);
+            if (static_cast<int32_t>(word) >= -0x8000 && static_cast<int32_t>(word) < 0x8000) {
+                emit(expansion, "addiu", {a[0], "$zero", numberText(expansion, static_cast<int32_t>(word))});
+            } else if ((word & 0xFFFF) == 0) {
+                emit(expansion, "lui", {a[0], numberText(expansion, word >> 16)});
+            } else {
+                emit(expansion, "lui", {a[0], numberText(expansion, word >> 16)});
+                emit(expansion, "ori", {a[0], a[0], numberText(expansion, word & 0xFFFF)});
+            }
+            break;
+        }
+        case PSEUDO_LA:  // two words, the address is not known in the first pass
+            emit(expansion, "lui", {a[0], a[1]}, SYNTAX_RT_HI);
+            emit(expansion, "ori", {a[0], a[0], a[1]}, SYNTAX_RT_RS_LO);
+            break;
+        case PSEUDO_MOVE:
+            emit(expansion, "addu", {a[0], a[1], "$zero"});
+            break;
+        case PSEUDO_NOT:
+            emit(expansion, "nor", {a[0], a[1], "$zero"});
+            break;
+        case PSEUDO_NEG:
+            emit(expansion, "sub", {a[0], "$zero", a[1]});
+            break;
+        case PSEUDO_B:
+            emit(expansion, "beq", {"$zero", "$zero", a[0]});
+            break;
+        case PSEUDO_BEQZ:
+            emit(expansion, "beq", {a[0], "$zero", a[1]});
+            break;
+        case PSEUDO_BNEZ:
+            emit(expansion, "bne", {a[0], "$zero", a[1]});
+            break;
+        case PSEUDO_BLT:
+            emit(expansion, "slt", {"$at", a[0], a[1]});
+            emit(expansion, "bne", {"$at", "$zero", a[2]});
+            break;
+        case PSEUDO_BGT:
+            emit(expansion, "slt", {"$at", a[1], a[0]});
+            emit(expansion, "bne", {"$at", "$zero", a[2]});
+            break;
+        case PSEUDO_BLE:
+            emit(expansion, "slt", {"$at", a[1], a[0]});
+            emit(expansion, "beq", {"$at", "$zero", a[2]});
+            break;
+        case PSEUDO_BGE:
+            emit(expansion, "slt", {"$at", a[0], a[1]});
+            emit(expansion, "beq", {"$at", "$zero", a[2]});
+            break;
+    }
+}
+
+}  // namespace
+
+// --------------------------------------------------------
+
+std::string_view operandText(const LineTokens &tokens, std::string_view line) {
+    if (tokens.mnemonic.empty()) return {};
+    size_t begin = tokens.mnemonic.data() + tokens.mnemonic.size() - line.data();
+    size_t end = line.find('#');
+    if (end == std::string_view::npos) end = line.size();
+    return trim(line.substr(begin, end - begin));
+}
+
+// --------------------------------------------------------
+
+size_t splitOperands(std::string_view text, std::string_view *operands, size_t max) {
+    text = trim(text);
+    if (text.empty()) return 0;
+    size_t count = 0;
+    for (size_t begin = 0;;) {
+        size_t comma = text.find(',', begin);
+        std::string_view operand = trim(text.substr(begin, comma == std::string_view::npos ? comma : comma - begin));
+        if (operand.empty()) throw AssemblerError("Missing argument.");
+        if (count < max) operands[count] = operand;
+        ++count;
+        if (comma == std::string_view::npos) return count;
+        begin = comma + 1;
+    }
+}
+
+// --------------------------------------------------------
+
+bool MacroTable::define(const LineTokens &tokens, std::string_view line) {
+    if (!defining_) {
+        if (tokens.mnemonic == ".endm") throw AssemblerError(".endm without .macro.", ".endm");
+        if (tokens.mnemonic != ".macro") return false;
+
+        // from here on the lines belong to the definition, even if it is invalid
+        defining_ = true;
+        current_ = -1;
+        if (!tokens.label.empty()) throw AssemblerError("Labels in front of .macro are not supported.", std::string(tokens.label));
+        std::string_view text = operandText(tokens, line);
+        size_t name_end = 0;
+        while (name_end < text.size() && !isBlank(text[name_end]) && text[name_end] != ',') ++name_end;
+        std::string_view name = text.substr(0, name_end);
+        if (name.empty()) throw AssemblerError("Macro name missing.");
+        if (findInstruction(name) >= 0 || findPseudo(name) >= 0) {
+            throw AssemblerError(std::string("Macro name is an instruction: ") + std::string(name) + ".", std::string(name));
+        }
+
+        Macro macro;
+        std::string_view rest = trim(text.substr(name_end));
+        if (!rest.empty() && rest[0] == ',') rest.remove_prefix(1);  // ".macro name, a, b"
+        std::string_view params[MAX_MACRO_ARGUMENTS];
+        size_t param_cnt = splitOperands(rest, params, MAX_MACRO_ARGUMENTS);
+        if (param_cnt > MAX_MACRO_ARGUMENTS) throw AssemblerError("Too many macro parameters.");
+        for (size_t i = 0; i < param_cnt; ++i) {
+            std::string_view param = params[i];
+            if (!param.empty() && param[0] == '\\') param.remove_prefix(1);
+            if (param.empty() || param.find_first_of(" \t\\(),") != std::string_view::npos) {
+                throw AssemblerError(std::string("Invalid macro parameter: ") + std::string(params[i]) + ".", std::string(params[i]));
+            }
+            macro.params.push_back(param);
+        }
+
+        // a macro defined again replaces the earlier one
+        auto [entry, inserted] = names_.try_emplace(std::string(name), macros_.size());
+        current_ = static_cast<int>(entry->second);
+        if (inserted) {
+            macros_.push_back(std::move(macro));
+        } else {
+            macros_[current_] = std::move(macro);
+        }
+        return true;
+    }
+
+    if (tokens.mnemonic == ".endm") {
+        defining_ = false;
+        return true;
+    }
+    if (tokens.mnemonic == ".macro") throw AssemblerError("Nested macro definitions are not supported.", ".macro");
+    if (!tokens.label.empty()) throw AssemblerError("Labels in macros are not supported.", std::string(tokens.label));
+    if (current_ >= 0 && !tokens.mnemonic.empty()) macros_[current_].body.push_back(line);
+    return true;
+}
+
+// --------------------------------------------------------
+
+bool MacroTable::expand(const LineTokens &tokens, std::string_view line, Expansion &expansion) const {
+    expansion.clear();
+    if (tokens.mnemonic.empty()) return false;
+    int pseudo = findPseudo(tokens.mnemonic);
+    const Macro *macro = pseudo < 0 ? findMacro(tokens.mnemonic) : nullptr;
+    if (pseudo < 0 && !macro) {
+        // "lw rt, label" or "lw rt, label(base)", the lexer only takes a number
+        // as the offset of "lw rt, 4(base)"
+        if (tokens.shape != LINE_SHAPE_INVALID && tokens.shape != LINE_SHAPE_PAIR) return false;
+        std::string_view text = operandText(tokens, line);
+        size_t comma = text.find(',');
+        if (comma == std::string_view::npos || text.find(',', comma + 1) != std::string_view::npos) return false;
+        std::string_view offset = trim(text.substr(comma + 1)), base;
+        if (!splitMemoryOperand(offset, offset, base)) base = {};
+        return expandMemoryLabel(tokens.mnemonic, trim(text.substr(0, comma)), offset, base, expansion);
+    }
+
+    std::string_view operands[MAX_MACRO_ARGUMENTS];
+    size_t operand_cnt = splitOperands(operandText(tokens, line), operands, MAX_MACRO_ARGUMENTS);
+    if (operand_cnt > MAX_MACRO_ARGUMENTS) throw AssemblerError("Wrong amount of arguments, operation not supported.");
+    if (pseudo >= 0) {
+        expandPseudo(pseudo, operands, operand_cnt, expansion);
+    } else {
+        expandCall(*macro, operands, operand_cnt, 1, expansion);
+    }
+    return true;
+}
+
+// --------------------------------------------------------
+
+void MacroTable::clear() {
+    names_.clear();
+    macros_.clear();
+    defining_ = false;
+    current_ = -1;
+}
+
+// --------------------------------------------------------
+
+const MacroTable::Macro *MacroTable::findMacro(std::string_view name) const {
+    if (names_.empty()) return nullptr;  // most sources have no macros, no key is built then
+    auto entry = names_.find(std::string(name));
+    return entry == names_.end() ? nullptr : &macros_[entry->second];
+}
+
+// --------------------------------------------------------
+
+void MacroTable::expandCall(const Macro &macro,
+                            const std::string_view *arguments,
+                            size_t argument_cnt,
+                            int depth,
+                            Expansion &expansion) const {
+    if (depth > MAX_MACRO_DEPTH) throw AssemblerError("Macros are nested too deeply.");
+    if (argument_cnt != macro.params.size()) {
+        throw AssemblerError(std::string("Wrong amount of arguments for macro: ") + std::to_string(argument_cnt) + ".");
+    }
+
+    auto substitute = [&](std::string_view s) {
+        if (s.size() < 2 || s[0] != '\\') return s;
+        for (size_t i = 0; i < argument_cnt; ++i) {
+            if (s.substr(1) == macro.params[i]) return arguments[i];
+        }
+        throw AssemblerError(std::string("Unknown macro parameter: ") + std::string(s) + ".", std::string(s));
+    };
+
+    for (std::string_view body_line: macro.body) {
+        LineTokens tokens = lexLine(body_line);
+        std::string_view operands[MAX_MACRO_ARGUMENTS];
+        size_t operand_cnt = splitOperands(operandText(tokens, body_line), operands, MAX_MACRO_ARGUMENTS);
+        if (operand_cnt > MAX_MACRO_ARGUMENTS) throw AssemblerError("Wrong amount of arguments, operation not supported.");
+        std::string_view mnemonic = substitute(tokens.mnemonic);
+
+        // parameters in "offset(base)" of an instruction are replaced separately
+        std::string_view offset, base;
+        if (operand_cnt == 2 && findInstruction(mnemonic) >= 0 && splitMemoryOperand(operands[1], offset, base)) {
+            if (expandMemoryLabel(mnemonic, substitute(operands[0]), substitute(offset), substitute(base), expansion)) {
+                continue;
+            }
+            ExpandedInstruction instruction;
+            instruction.parts[0] = mnemonic;
+            instruction.parts[1] = substitute(operands[0]);
+            instruction.parts[2] = substitute(base);
+            instruction.parts[3] = substitute(offset);
+            instruction.partCount = 4;
+            expansion.instructions.push_back(instruction);
+            continue;
+        }
+        for (size_t i = 0; i < operand_cnt; ++i) operands[i] = substitute(operands[i]);
+        expandOperation(mnemonic, operands, operand_cnt, depth, expansion);
+    }
+}
+
+// --------------------------------------------------------
+
+void MacroTable::expandOperation(std::string_view mnemonic,
+                                 const std::string_view *operands,
+                                 size_t operand_cnt,
+                                 int depth,
+                                 Expansion &expansion) const {
+    int pseudo = findPseudo(mnemonic);
+    if (pseudo >= 0) {
+        expandPseudo(pseudo, operands, operand_cnt, expansion);
+        return;
+    }
+    if (const Macro *macro = findMacro(mnemonic)) {
+        expandCall(*macro, operands, operand_cnt, depth + 1, expansion);
+        return;
+    }
+
+    // an instruction, in the order of instructionParts
+    if (operand_cnt > 3) throw AssemblerError("Wrong amount of arguments, operation not supported.");
+    ExpandedInstruction instruction;
+    instruction.parts[0] = mnemonic;
+    std::string_view offset, base;
+    bool memory_operand = operand_cnt == 2 && splitMemoryOperand(operands[1], offset, base);
+    if (operand_cnt == 2 && expandMemoryLabel(mnemonic, operands[0], memory_operand ? offset : operands[1],
+                                              memory_operand ? base : std::string_view(), expansion)) {
+        return;
+    }
+    if (memory_operand) {
+        instruction.parts[1] = operands[0];
+        instruction.parts[2] = base;
+        instruction.parts[3] = offset;
+        instruction.partCount = 4;
+    } else {
+        for (size_t i = 0; i < operand_cnt; ++i) instruction.parts[i + 1] = operands[i];
+        instruction.partCount = operand_cnt + 1;
+    }
+    expansion.instructions.push_back(instruction);
+}
@@ -0,0 +1,122 @@
+#ifndef MIPS_MACROS_H
+#define MIPS_MACROS_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "lexer.hpp"
+#include "symbols.hpp"
+
+// most macros that may be expanded inside each other
+constexpr int MAX_MACRO_DEPTH = 16;
+
+// most operands of a pseudo-instruction or macro call
+constexpr size_t MAX_MACRO_ARGUMENTS = 8;
+
+/**
+ * @brief Instruction of the expansion of a pseudo-instruction or a macro. The
+ * parts are ordered like those of a source line, see instructionParts, and
+ * are views into the source, into literals or into the numbers of the
+ * Expansion.
+ */
+struct ExpandedInstruction {
+    std::string_view parts[4];
+    size_t partCount = 0;
+    int syntax = -1;  // SYNTAX_* that replaces the one of the instruction, -1 for none
+};
+
+/**
+ * @brief Instructions a source line expands to. It is reused for all lines,
+ * so expanding doesn't allocate once it has grown.
+ */
+struct Expansion {
+    std::vector<ExpandedInstruction> instructions;
+    Arena numbers{256};  // text of the numbers computed by the expansion
+
+    void clear() {
+        instructions.clear();
+        numbers.clear();
+    }
+};
+
+/**
+ * @brief Macros defined by ".macro name a, b" up to ".endm" and the expansion
+ * of macro calls and pseudo-instructions. A macro is known from its
+ * definition on, so a pass has to give every line to define() in order. In
+ * the body "\a" is replaced by the argument of a, as a whole operand or as
+ * the offset or base of "offset(base)". The body is kept as views into the
+ * source, so the table must not outlive it.
+ */
+class MacroTable {
+   public:
+    /**
+     * @brief Follows the definitions of the macros.
+     *
+     * @param tokens tokens of the line
+     * @param line the source line
+     * @return true, if the line belongs to a definition and takes no address
+     * @throws AssemblerError if the line is an invalid part of a definition,
+     * it belongs to the definition all the same
+     */
+    bool define(const LineTokens &tokens, std::string_view line);
+
+    /**
+     * @brief Expands a pseudo-instruction or a macro call.
+     *
+     * @param tokens tokens of the line
+     * @param line the source line
+     * @param expansion receives the instructions, it is cleared first
+     * @return false, if the line is neither, expansion is empty then
+     * @throws AssemblerError if the arguments are invalid
+     */
+    bool expand(const LineTokens &tokens, std::string_view line, Expansion &expansion) const;
+
+    /**
+     * @return true, while a definition is not closed by ".endm"
+     */
+    bool defining() const { return defining_; }
+
+    void clear();
+
+   private:
+    struct Macro {
+        std::vector<std::string_view> params;  // without the '\'
+        std::vector<std::string_view> body;    // lines
+    };
+
+    const Macro *findMacro(std::string_view name) const;  // nullptr if there is none
+    void expandCall(const Macro &macro,
+                    const std::string_view *arguments,
+                    size_t argument_cnt,
+                    int depth,
+                    Expansion &expansion) const;
+    void expandOperation(std::string_view mnemonic,
+                         const std::string_view *operands,
+                         size_t operand_cnt,
+                         int depth,
+                         Expansion &expansion) const;
+
+    std::unordered_map<std::string, size_t> names_;  // index into macros_ by name
+    std::vector<Macro> macros_;
+    bool defining_ = false;
+    int current_ = -1;  // index of the macro that is defined, -1 if the definition is invalid
+};
+
+/**
+ * @brief Operands of a line after its mnemonic, from the mnemonic to the
+ * comment.
+ */
+std::string_view operandText(const LineTokens &tokens, std::string_view line);
+
+/**
+ * @brief Splits operands at the commas and removes the blanks around them.
+ *
+ * @param operands receives views into text
+ * @return size_t number of operands, more than max if there are too many
+ * @throws AssemblerError if an operand is empty
+ */
+size_t splitOperands(std::string_view text, std::string_view *operands, size_t max);
+
+#endif
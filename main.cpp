@@ -1,494 +1,600 @@
+#include <algorithm>
 #include <fstream>
-#include <iomanip>
 #include <iostream>
-#include <map>
-#include <regex>
+#include <string>
 #include <vector>
-#include <stdexcept>
 
-#include "definitions.hpp"
+#include "assembler.hpp"
+#include "cache.hpp"
+#include "diagnostics.hpp"
+#include "directives.hpp"
+#include "object.hpp"
+#include "output.hpp"
+#include "server.hpp"
+#include "simulator.hpp"
+#include "source.hpp"
+#include "stats.hpp"
 
 /**
- * @brief First pass to find the addresses for each lable that occur.
+ * @brief Tries to convert a given string into an integer and 
+ * checks if that string can be converted into an integer at all.
+ * 
+ * @param s string
+ * @return std::pair<bool, int> first: bool, if the string can be
+ * converted to an integer; second: converted integer value, 0 if 
+ * conversion failed
+ */
+std::pair<bool, int> strtoi_safe(const std::string& s){
+    char* p;
+    int x = strtol(s.c_str(), &p, 10);
+    return {*p == 0, x};
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Settings selected on the command line.
+ */
+struct Options {
+    std::string input;         // "-" for stdin
+    std::string listing;       // no listing is generated if empty
+    std::string instructions;  // no image is written if empty
+    std::string data;          // no image of the data segment is written if empty
+    int imageFormat = IMAGE_FORMAT_HEX;
+    bool object = false;  // write a relocatable object instead of the image
+    bool onePass = false;
+    unsigned jobs = 0;  // worker threads, 0: one per hardware thread
+    size_t maxErrors = 50;  // 0: no limit
+    bool jsonDiagnostics = false;
+    bool stats = false;  // report times and counters on stderr
+    bool jsonStats = false;
+
+    // run the assembled program
+    bool run = false;
+    uint64_t maxSteps = 0;  // 0: no limit
+    size_t memorySize = 1 << 20;
+
+    bool incremental = false;
+    std::string cache;  // default: next to the instructions or the input
+
+    std::string serve;  // socket of the server mode, empty if not serving
+
+    // batch mode
+    bool batch = false;
+    std::vector<std::string> inputs;  // also the objects of the link mode
+    bool listings = false;  // write a listing next to each input
+
+    bool link = false;  // link the objects in inputs
+};
+
+void printUsage(std::ostream &out, const char *program) {
+    out << "usage: " << program << " [options] <input> [<listing> <instructions>]\n"
+        << "       " << program << " [options] -o <instructions> <input>\n"
+        << "       " << program << " --batch [options] <input>...\n"
+        << "       " << program << " --run [options] <input>\n"
+        << "       " << program << " --link [options] -o <instructions> <object>...\n"
+        << "       " << program << " --serve <socket>\n"
+        << "\n"
+        << "  <input> may be \"-\" to read from stdin\n"
+        << "\n"
+        << "options:\n"
+        << "  -o, --output <file>    file for the encoded instructions\n"
+        << "  -l, --listing <file>   also write a listing with the symbol table\n"
+        << "  -f, --format <format>  hex (default), bin-le, bin-be, ihex or vmem\n"
+        << "      --data <file>      file for the data segment, in the same format\n"
+        << "  -c, --object           write a relocatable object instead of the instructions\n"
+        << "      --one-pass         read the source once and backpatch labels\n"
+        << "  -i, --incremental      only parse the lines that changed since the last run;\n"
+        << "                         ignored with a listing, stdin or -c\n"
+        << "      --cache <file>     cache of --incremental (default <instructions>.cache)\n"
+        << "  -j, --jobs <n>         number of worker threads\n"
+        << "      --max-errors <n>   stop after n errors, 0 for no limit (default 50)\n"
+        << "      --diagnostics-format <format>\n"
+        << "                         text (default) or json, written to stderr\n"
+        << "      --stats            report times of the passes and counters on stderr\n"
+        << "      --stats-format <format>\n"
+        << "                         text (default) or json, implies --stats\n"
+        << "  -h, --help             show this help\n"
+        << "\n"
+        << "run options:\n"
+        << "  -r, --run              execute the program and print the registers and memory\n"
+        << "      --max-steps <n>    stop after n instructions, 0 for no limit (default)\n"
+        << "      --memory <bytes>   size of the data memory (default 1048576)\n"
+        << "\n"
+        << "batch options:\n"
+        << "  -b, --batch            assemble each input to <input>.<format>, or to\n"
+        << "                         <input>.o with -c; data goes to <input>.data.<format>\n"
+        << "      --manifest <file>  read more inputs from a file, one per line\n"
+        << "      --listings         also write <input>.lst for each input\n"
+        << "\n"
+        << "link options:\n"
+        << "      --link             link objects written by -c, the first one starts at\n"
+        << "                         address 0; takes -o, --data, -f, -j, --manifest and\n"
+        << "                         --run\n"
+        << "\n"
+        << "server options:\n"
+        << "      --serve <socket>   answer requests on a Unix domain socket, one line of\n"
+        << "                         tab separated arguments per request\n";
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Appends the paths listed in a manifest file, one per line. Empty
+ * lines and lines starting with '#' are skipped.
  *
- * @param fileReader input file stream of the file that contains the raw
- * instructions
- * @param labelAddrMap reference to the map that will store the numerical
- * addresses of each label
+ * @return true, if the manifest could be read
  */
-void firstPass(std::ifstream &fileReader, std::map<std::string, int> &labelAddrMap) {
-    std::string currentLine;
-    unsigned int addrPointer = 0;
-    std::smatch match;
-    std::regex regex1(R"(^\s*[^\s#]+\s*#*)");
-    std::regex regex2("[^#]*");
-    std::regex regex3("\\S*(?=:)");
-    std::regex regex4(":[^#]*[^#\\s]#*");
-
-    while (getline(fileReader, currentLine)) {
-        bool labelSingle = false;
-        // Looking for lines with codes
-        if (std::regex_search(currentLine, regex1)) {
-            // Looking for code without comments (we keep everything before a #)
-            if (std::regex_search(currentLine, match, regex2)) {
-                std::string lineWithoutComments = match.str(0);
-                // Looking for a label name
-                if (std::regex_search(lineWithoutComments, match, regex3)) {
-                    labelAddrMap[match.str(0)] = addrPointer;
-
-                    // Looking if there is no code after the label
-                    if (!std::regex_search(lineWithoutComments, regex4)) {
-                        labelSingle = true;
-                    }
-                }
-                if (!labelSingle) addrPointer += 4;
-            }
-        }
+bool readManifest(const std::string &path, std::vector<std::string> &inputs) {
+    SourceFile manifest;
+    if (!manifest.open(path)) return false;
+
+    std::string_view line;
+    size_t pos = 0;
+    while (nextLine(manifest.text(), pos, line)) {
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line.empty() || line[0] == '#') continue;
+        inputs.emplace_back(line);
     }
+    return true;
 }
 
 // --------------------------------------------------------
 
 /**
- * @brief Converts a register abbreviation into the numerical index of the
- * corresponding register.
+ * @brief Parses the command line. Options may be given as "--name value" or
+ * "--name=value".
  *
- * @param s String that contains the register abbreviation. Must begin with '$'
- * followed by either the numeric index or the alphanumerical abbreviation. E.g.
- * "$14" or "$t1".
- * @param errout Reference to a file output stream where the error message
- * should be printed to.
- * @return uint32_t the numerical index of the corresponding register. 0, if an
- * error occured.
+ * @return true, if the command line is valid
  */
-uint32_t regCode(const std::string &s, std::ofstream &errout) {
-    if (!std::regex_match(s, std::regex(R"([$](zero|[0-9]{2}|[a-z]\d|[a-z]{2}))"))) {
-        errout << "Error: Register string invalid: " << s << ". Abort ...\n";
-        errout.close();
-        exit(EXIT_FAILURE);
-    }
+bool parseOptions(const std::vector<std::string> &args, Options &options) {
+    std::vector<std::string> positional;
+    for (size_t i = 0; i < args.size(); ++i) {
+        std::string arg(args[i]);
+        if (arg.size() < 2 || arg[0] != '-') {
+            positional.push_back(arg);
+            continue;
+        }
 
-    uint32_t register_number = 0;
-    if (s[1] >= 48 &&
-        s[1] <= 57) {  // there is a number after $ -> no abbreviations
-        register_number = stoi(s.substr(1, s.length() - 1));
-        if (register_number < 0 || register_number > 31) {
-            errout << "Error: Register out of range: " << register_number << ". Abort ...\n";
-            errout.close();
-            exit(EXIT_FAILURE);
+        std::string value;
+        bool has_value = false;
+        size_t equals = arg.find('=');
+        if (arg.rfind("--", 0) == 0 && equals != std::string::npos) {
+            value = arg.substr(equals + 1);
+            arg.resize(equals);
+            has_value = true;
+        }
+        auto take_value = [&]() {
+            if (!has_value && i + 1 < args.size()) {
+                value = args[++i];
+                has_value = true;
+            }
+            return has_value;
+        };
+
+        if (arg == "-o" || arg == "--output") {
+            if (!take_value()) return false;
+            options.instructions = value;
+        } else if (arg == "--data") {
+            if (!take_value()) return false;
+            options.data = value;
+        } else if (arg == "-l" || arg == "--listing") {
+            if (!take_value()) return false;
+            options.listing = value;
+        } else if (arg == "-f" || arg == "--format") {
+            if (!take_value()) return false;
+            options.imageFormat = imageFormatFromName(value);
+            if (options.imageFormat < 0) return false;
+        } else if ((arg == "-c" || arg == "--object") && !has_value) {
+            options.object = true;
+        } else if (arg == "--link" && !has_value) {
+            options.link = true;
+        } else if (arg == "--one-pass" && !has_value) {
+            options.onePass = true;
+        } else if ((arg == "-i" || arg == "--incremental") && !has_value) {
+            options.incremental = true;
+        } else if (arg == "--cache") {
+            if (!take_value()) return false;
+            options.cache = value;
+        } else if ((arg == "-b" || arg == "--batch") && !has_value) {
+            options.batch = true;
+        } else if (arg == "--listings" && !has_value) {
+            options.listings = true;
+        } else if (arg == "--manifest") {
+            if (!take_value() || !readManifest(value, options.inputs)) return false;
+        } else if (arg == "-j" || arg == "--jobs") {
+            if (!take_value()) return false;
+            auto jobs = strtoi_safe(value);
+            if (!jobs.first || jobs.second < 1) return false;
+            options.jobs = jobs.second;
+        } else if (arg == "--max-errors") {
+            if (!take_value()) return false;
+            auto max_errors = strtoi_safe(value);
+            if (!max_errors.first || max_errors.second < 0) return false;
+            options.maxErrors = max_errors.second;
+        } else if ((arg == "-r" || arg == "--run") && !has_value) {
+            options.run = true;
+        } else if (arg == "--max-steps" || arg == "--memory") {
+            if (!take_value()) return false;
+            char *end;
+            unsigned long long number = strtoull(value.c_str(), &end, 10);
+            if (value.empty() || *end != 0 || value[0] == '-') return false;
+            if (arg == "--max-steps") {
+                options.maxSteps = number;
+            } else {
+                if (number % 4 != 0 || number >= 0x100000000ull) return false;
+                options.memorySize = number;
+            }
+        } else if (arg == "--serve") {
+            if (!take_value()) return false;
+            options.serve = value;
+        } else if (arg == "--diagnostics-format") {
+            if (!take_value() || (value != "text" && value != "json")) return false;
+            options.jsonDiagnostics = value == "json";
+        } else if (arg == "--stats" && !has_value) {
+            options.stats = true;
+        } else if (arg == "--stats-format") {
+            if (!take_value() || (value != "text" && value != "json")) return false;
+            options.stats = true;
+            options.jsonStats = value == "json";
+        } else {
+            return false;
         }
-        return register_number;
     }
 
-    // register abbreviations
-    const auto result = REGISTER_ABRV.find(s);
-    if (result == REGISTER_ABRV.end()) {
-        errout << "Error: Register abbreviation not supported: " << s << ". Abort ...\n";
-        errout.close();
-        exit(EXIT_FAILURE);
+    if (!options.serve.empty()) return positional.empty() && !options.batch && !options.run && !options.link;
+    if (options.link) {
+        options.inputs.insert(options.inputs.end(), positional.begin(), positional.end());
+        return !options.inputs.empty() && (!options.instructions.empty() || options.run) && options.listing.empty() &&
+               !options.batch && !options.object;
+    }
+    // an object holds its data
+    if (options.object && (options.run || !options.data.empty())) return false;
+    if (options.batch) {
+        options.inputs.insert(options.inputs.end(), positional.begin(), positional.end());
+        return !options.inputs.empty() && options.listing.empty() && options.instructions.empty() &&
+               options.data.empty() && !options.run;
     }
 
-    return result->second;
+    // the old interface "input listing instructions" is still accepted
+    if (positional.size() == 3 && options.listing.empty() && options.instructions.empty()) {
+        options.listing = positional[1];
+        options.instructions = positional[2];
+    } else if (positional.size() != 1 || (options.instructions.empty() && !options.run)) {
+        return false;
+    }
+    options.input = positional[0];
+    return true;
 }
 
 // --------------------------------------------------------
 
 /**
- * @brief Converts a MIPS instruction into its binary form.
+ * @brief Writes encoded instructions or the data segment into a file, in the
+ * format selected on the command line.
  *
- * @param instruction_parts a valid MIPS instruction that was split into its
- * parts so it won't containt any whitespaces or other seperators. E.g. "add
- * $t2, $t1, $t1" has to be split into {"add", "$t2", "$t1", "$t1"}
- * @param errout Reference to a file output stream where the error message
- * should be printed to.
- * @return uint32_t binary MIPS instruction
+ * @param image the words of the instructions or the bytes of the data, see
+ * writeImage
+ * @param diagnostics receives the error if the file can't be written
+ * @return true, if the file could be opened
  */
-uint32_t binInstruction(const std::vector<std::string> &instruction_parts, std::ofstream &errout) {
-    size_t argument_cnt = instruction_parts.size();
-    if (argument_cnt == 0) {
-        errout << "Error: Empty instruction can't be converted to binary. Abort ...\n";
-        errout.close();
-        exit(EXIT_FAILURE);
+template <class Image>
+bool writeImageFile(const Options &options, const std::string &path, const Image &image, Diagnostics &diagnostics) {
+    std::ios::openmode image_mode = std::ios::out;
+    if (options.imageFormat == IMAGE_FORMAT_BIN_LE || options.imageFormat == IMAGE_FORMAT_BIN_BE) {
+        image_mode |= std::ios::binary;
     }
-
-    if(instruction_parts[0] == "exit"){
-        return ~0u;
-    }
-
-    // find codes and layout for instruction
-    const auto result = INSTR_CODES.find(instruction_parts[0]);
-    if (result == INSTR_CODES.end()) {
-        errout << "Error: Instruction " << instruction_parts[0] << " is not supported. Abort ...\n";
-        errout.close();
-        exit(EXIT_FAILURE);
+    std::ofstream outputInstructionsFile(path, image_mode);
+    if(!outputInstructionsFile.is_open()){
+        diagnostics.report(0, 0, SEVERITY_ERROR, "Can't write " + path);
+        return false;
     }
-    InstructionCodes instruction_codes = result->second;
-
-    // 1. op-code - first (left) 6 bits
-    uint32_t binary_instr = 0x00000000;
-    binary_instr |= instruction_codes.op_code << 26;
-
-    // 2. parse arguments
-    switch (instruction_codes.format) {
-        case INSTR_TYPE_R:
-            if (argument_cnt == 2) {  // jr instruction
-                binary_instr |= regCode(instruction_parts[1], errout) << 21;
-                binary_instr |= instruction_codes.function;
-                break;
-            }
-
-            if (argument_cnt != 4) {
-                errout << "Error: Wrong amount of arguments for instruction type R: " << argument_cnt << ".\n";
-                errout.close();
-                exit(EXIT_FAILURE);
-            }
-
-            binary_instr |= regCode(instruction_parts[2], errout) << 21;  // rs
-            binary_instr |= regCode(instruction_parts[3], errout) << 16;  // rt
-            binary_instr |= regCode(instruction_parts[1], errout) << 11;  // rd
-            binary_instr |= instruction_codes.function;  // func. code
-            break;
-
-        case INSTR_TYPE_R_SHIFT:
-            if (argument_cnt != 4) {
-                errout << "Error: Wrong amount of arguments for instruction type R: " << argument_cnt << ".\n";
-                errout.close();
-                exit(EXIT_FAILURE);
-            }
-
-            binary_instr |= regCode(instruction_parts[2], errout) << 16;  // rt
-            binary_instr |= regCode(instruction_parts[1], errout) << 11;  // rd
-            binary_instr |= stoi(instruction_parts[3]) << 6;              // sh
-            binary_instr |= instruction_codes.function;  // func. code
-            break;
-
-        case INSTR_TYPE_I:
-            if (argument_cnt != 3 && argument_cnt != 4) {
-                errout << "Error: Wrong amount of arguments for instruction type I: " << argument_cnt << ".\n";
-                errout.close();
-                exit(EXIT_FAILURE);
-            }
-
-            if(stoi(instruction_parts[3]) > 0xFFFF){
-                errout << "Error: Argument too long.\n";
-                errout.close();
-                exit(EXIT_FAILURE);
-            }
-
-            // format: {instr, rt, rs, imm} or {instr, rt, rs, offset}
-            binary_instr |= regCode(instruction_parts[2], errout) << 21;  // rs
-            binary_instr |= regCode(instruction_parts[1], errout) << 16;  // rt
-            binary_instr |= stoi(instruction_parts[3]) & 0xFFFF;  // imm or offset
-            break;
-
-        case INSTR_TYPE_J:
-            if (argument_cnt != 2) {
-                errout << "Error: Wrong amount of arguments for instruction type J: " << argument_cnt << ".\n";
-                errout.close();
-                exit(EXIT_FAILURE);
-            }
+    writeImage(outputInstructionsFile, image, options.imageFormat);
+    return true;
+}
 
-            if(stoi(instruction_parts[1]) > 0x3FFFFFF){
-                errout << "Error: Jump address too long.\n";
-                errout.close();
-                exit(EXIT_FAILURE);
-            }
+// --------------------------------------------------------
 
-            binary_instr |= stoi(instruction_parts[1]) & 0x3FFFFFF;
-            break;
+/**
+ * @brief Assembles one source file into the files given by options. Every
+ * call uses its own assembler, so several files can be assembled
+ * concurrently.
+ *
+ * @param options input, output files and modes
+ * @param assembler assembles the source, its settings are taken from options.
+ * The encoded instructions stay available in it.
+ * @param diagnostics receives the errors. They are also written to the
+ * listing, if there is one. The files of the instructions and the data or
+ * the object are only written if there are none.
+ * @param stats receives the times and counters, nullptr if they are not needed
+ * @return true, if the file was assembled without errors
+ */
+bool assembleFile(const Options &options, Assembler &assembler, Diagnostics &diagnostics, AssemblerStats *stats) {
+    StatsTimer total_timer(stats, STATS_TOTAL);
+    StatsTimer read_timer(stats, STATS_READ);
 
-        case INSTR_TYPE_NULL:
-        default:
-            binary_instr = 0u;
-            break;
+    // open files
+    SourceFile source;
+    if(!source.open(options.input)){
+        diagnostics.report(0, 0, SEVERITY_ERROR, "Can't read " + options.input);
+        return false;
+    }
+    read_timer.stop();
+    std::ofstream outputListingFile;
+    if (!options.listing.empty()) {
+        outputListingFile.open(options.listing);
+        if (!outputListingFile.is_open()) {
+            diagnostics.report(0, 0, SEVERITY_ERROR, "Can't write " + options.listing);
+            return false;
+        }
     }
 
-    return binary_instr;
+    AssemblerOptions &settings = assembler.options();
+    settings.listing = !options.listing.empty();
+    settings.onePass = options.onePass;
+    settings.object = options.object;
+    settings.jobs = options.jobs;
+    settings.maxErrors = options.maxErrors;
+    settings.stats = stats;
+
+    std::string cache_path = options.cache;
+    if (cache_path.empty()) cache_path = (options.instructions.empty() ? options.input : options.instructions) + ".cache";
+    bool incremental = options.incremental;
+    if (incremental) {
+        // the cache keeps neither listing lines nor objects
+        const char *reason = !options.listing.empty() ? "a listing is written"
+                             : options.input == "-"   ? "the source is read from stdin"
+                             : options.object         ? "an object is written"
+                                                      : nullptr;
+        if (reason) {
+            diagnostics.report(0, 0, SEVERITY_WARNING, std::string("--incremental is ignored because ") + reason);
+            incremental = false;
+        }
+    }
+    LineCache cache;
+    if (incremental) cache.load(cache_path);
+
+    bool success = assembler.assemble(source.text(), options.input, incremental ? &cache : nullptr);
+    diagnostics.append(assembler.diagnostics());
+    if (incremental && success) cache.save(cache_path);
+    if (outputListingFile.is_open()) {
+        outputListingFile.write(assembler.listing().data(), static_cast<std::streamsize>(assembler.listing().size()));
+    }
+    if (!success) return false;
+    if (options.instructions.empty() && options.data.empty()) return true;
+
+    StatsTimer image_timer(stats, STATS_IMAGE);
+    if (options.object) {
+        if (assembler.object().save(options.instructions)) return true;
+        diagnostics.report(0, 0, SEVERITY_ERROR, "Can't write " + options.instructions);
+        return false;
+    }
+    if (!options.instructions.empty() && !writeImageFile(options, options.instructions, assembler.words(), diagnostics)) {
+        return false;
+    }
+    return options.data.empty() || writeImageFile(options, options.data, assembler.data(), diagnostics);
 }
 
 // --------------------------------------------------------
 
 /**
- * @brief outputPrinting generates the two output files after the execution
- * of the second pass
+ * @brief Links the objects given as inputs and writes the program and its
+ * data into the files given by options, if there are any. The objects are
+ * read in parallel.
  *
- * @param outputListing output file stream for the file containing the listing
- * @param outputInstructions output file stream for the file containing the
- * instructions
- * @param result contain the parts of the MIPS instruction to handle
- * @param comment contain the comment if there is one on the line
- * @param label contain the label which is placed at the beginning of the line
- * if there is one
- * @param labelCall in case of instruction "j" or "beq", contain the label
- * name to jump to
- * @param instruction_count contain the current instruction address
- * @param labelSingle is true if a label is the only element on the line
- * (doesn't take into account potential comment)
+ * @param options objects, output files and format
+ * @param words receives the linked program
+ * @param data receives the linked data segment
+ * @param diagnostics receives one entry per object, named after its source
+ * @param stats receives the times and counters, nullptr if they are not needed
+ * @return true, if the program was linked and written without errors
  */
-void outputPrinting(std::ofstream &outputListing,
-            std::ofstream &outputInstructions,
-            std::vector<std::string> &result,
-            std::string &comment,
-            std::string &label,
-            std::string &labelCall,
-            int &instruction_count,
-            bool &labelSingle) {
-    if (!result.empty() && result[0] == "err") {
-        outputListing << "Error: Wrong amount of arguments, operation not supported" << ".\n";
-        outputListing.close();
-        exit(EXIT_FAILURE);
-    } else {
-        if (result.size() != 0) {
-            uint32_t binary_instruction = binInstruction(result, outputListing);
-
-            // output listing
-            std::ios hex_format(nullptr);
-            outputListing << "0x";
-            outputListing << std::hex << std::setw(8) << std::setfill('0');
-            hex_format.copyfmt(outputListing);
-            outputListing << instruction_count;
-            outputListing << "    0x";
-            outputListing.copyfmt(hex_format);
-            outputListing << binary_instruction;
-            if (label.empty()) {
-                outputListing << "                  ";
-            } else {
-                outputListing << "    ";
-                outputListing << std::left << std::setw(10) << std::setfill(' ') << label << std::right;
-                outputListing << "    ";
-            }
-            if (result[0] == "sw" || result[0] == "lw") {
-                outputListing << result[0] << " " << result[1] << " " << result[3] << "(" << result[2] << ") ";
-            } else if (result[0] == "j" && !labelCall.empty()) {
-                outputListing << result[0] << " " << labelCall << " ";
-            } else if (result[0] == "beq" && !labelCall.empty()) {
-                outputListing << result[0] << " " << result[2] << " " << result[1] << " " << labelCall << " ";
-            } else {
-                for (const auto &s: result) {
-                    outputListing << s << " ";
-                }
-            }
-            if (!comment.empty()) {
-                outputListing << "    ";
-                outputListing << comment;
-            }
-            outputListing << "\n";
-
-            // output instructions
-            outputInstructions << "0x";
-            outputInstructions.copyfmt(hex_format);
-            outputInstructions << binary_instruction << "\n";
-            if (!labelSingle) instruction_count += 4;
+bool linkFiles(const Options &options,
+               std::vector<uint32_t> &words,
+               std::vector<uint8_t> &data,
+               std::vector<Diagnostics> &diagnostics,
+               AssemblerStats *stats) {
+    StatsTimer total_timer(stats, STATS_TOTAL);
+    StatsTimer read_timer(stats, STATS_READ);
+    size_t object_cnt = options.inputs.size();
+    std::vector<ObjectFile> objects(object_cnt);
+    std::vector<char> loaded(object_cnt);
+    runParallel(object_cnt, options.jobs, [&](size_t i) { loaded[i] = objects[i].load(options.inputs[i]); });
+    read_timer.stop();
+
+    bool success = true;
+    for (size_t i = 0; i < object_cnt; ++i) {
+        if (loaded[i]) {
+            diagnostics.emplace_back(std::string(objects[i].source()), options.maxErrors);
         } else {
-            if (!label.empty() || !comment.empty()) {
-                outputListing << "                            ";
-            }
-            if (!label.empty()) {
-                outputListing << label;
-            }
-            if (!comment.empty()) {
-                if (!label.empty()) {
-                    outputListing << "    ";
-                }
-                outputListing << comment;
-            }
-            outputListing << "\n";
+            diagnostics.emplace_back(options.inputs[i], options.maxErrors);
+            diagnostics.back().report(0, 0, SEVERITY_ERROR, "Can't read the object " + options.inputs[i]);
+            success = false;
         }
     }
+    if (!success || !linkObjects(objects, words, data, diagnostics, options.jobs)) return false;
+    if (stats) {
+        stats->files += object_cnt;
+        stats->instructions += words.size();
+    }
+
+    StatsTimer image_timer(stats, STATS_IMAGE);
+    if (!options.instructions.empty()) {
+        diagnostics.emplace_back(options.instructions);
+        if (!writeImageFile(options, options.instructions, words, diagnostics.back())) return false;
+        diagnostics.pop_back();
+    }
+    if (!options.data.empty()) {
+        diagnostics.emplace_back(options.data);
+        if (!writeImageFile(options, options.data, data, diagnostics.back())) return false;
+        diagnostics.pop_back();
+    }
+    return true;
 }
 
 // --------------------------------------------------------
 
 /**
- * @brief symbolsOutputPrinting print the symbols at the ends of the listing
- * file when the outputPrinting function has finished
+ * @brief Executes the program and prints the state of the simulator.
  *
- * @param outputListing output file stream for the file containing the listing
- * @param labelAddrMap reference to a map that holds the numerical addresses for
- * each label
+ * @return int exit code
+ */
+int runProgram(const Options &options,
+               const std::vector<uint32_t> &words,
+               const std::vector<uint8_t> &data,
+               std::ostream &out) {
+    Simulator simulator(words, data, options.memorySize);
+    int stop = simulator.run(options.maxSteps);
+    simulator.writeState(out, stop);
+    return stop == SIM_STOP_EXIT || stop == SIM_STOP_END ? 0 : 1;
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Writes the diagnostics of all files in the format selected on the
+ * command line.
  */
-void symbolsOutputPrinting(std::ofstream &outputListing, std::map<std::string, int> &labelAddrMap) {
-    outputListing << "\nSymbols\n";
-    for (const auto &lbl: labelAddrMap) {
-        outputListing << std::left << std::setw(13) << std::setfill(' ');
-        outputListing << lbl.first << " ";
-        outputListing << "0x";
-        outputListing << std::hex << std::right << std::setw(8) << std::setfill('0');
-        outputListing << lbl.second;
-        outputListing << "\n";
+void writeDiagnostics(const Options &options, const std::vector<Diagnostics> &files, std::ostream &err) {
+    if (options.jsonDiagnostics) {
+        writeDiagnosticsJson(err, files);
+        return;
     }
+    for (const auto &file: files) file.writeText(err);
 }
 
 // --------------------------------------------------------
 
 /**
- * @brief Tries to convert a given string into an integer and 
- * checks if that string can be converted into an integer at all.
- * 
- * @param s string
- * @return std::pair<bool, int> first: bool, if the string can be
- * converted to an integer; second: converted integer value, 0 if 
- * conversion failed
+ * @brief Writes the stats in the format selected on the command line.
  */
-std::pair<bool, int> strtoi_safe(const std::string& s){
-    char* p;
-    int x = strtol(s.c_str(), &p, 10);
-    return {*p == 0, x};
+void writeStats(const Options &options, const AssemblerStats &stats, std::ostream &err) {
+    if (options.jsonStats) {
+        writeStatsJson(err, stats);
+    } else {
+        writeStatsText(err, stats);
+    }
 }
 
 // --------------------------------------------------------
 
 /**
- * @brief Second pass to validate the instructions, handle comments, split the
- * instructions into their parts and eventually convert and print them.
+ * @brief Assembles all inputs of the batch on a pool of worker threads. The
+ * outputs of each input are written next to it. Errors are reported in the
+ * order of the inputs.
  *
- * @param fileReader input file stream of the file that contains the raw
- * instructions
- * @param outputListing output file stream for the file containing the listing
- * @param outputInstructions output file stream for the file containing the
- * instructions
- * @param labelAddrMap reference to a map that holds the numerical addresses for
- * each label
+ * @param options inputs and modes
+ * @param err receives the diagnostics
+ * @return int number of inputs that failed
  */
-void secondPass(std::ifstream &fileReader,
-                std::ofstream &outputListing,
-                std::ofstream &outputInstructions,
-                std::map<std::string, int> &labelAddrMap) {
-    fileReader.clear();
-    fileReader.seekg(0);
-    std::string currentLine;
-    int instruction_count = 0;
-    std::smatch match;
-    std::regex regex1(R"(.*(#.*))");
-    std::regex regex2((R"(^\s*[^\s#]+\s*#*)"));
-    std::regex regex3("[^#]*");
-    std::regex regex4((R"(\S*:)"));
-    std::regex regex5(":[^#]*[^#\\s]#*");
-    std::regex regex6(R"(\S*:)");
-    std::regex firstMatch(R"(^\s*(\S+)\s*$)");
-    std::regex secondMatch(R"(^\s*(\S+)\s+(\S+)\s*$)");
-    std::regex thirdMatch(R"(^\s*(\S+)\s+(\S+),\s*(\d+)\((\S+)\)\s*$)");
-    std::regex fourthMatch(R"(^\s*(\S+)\s+(\S+),\s*(-\d+)\((\S+)\)\s*$)");
-    std::regex fifthMatch(R"(^\s*(\S+)\s+(\S+),\s*(\S+),\s*(\S+)\s*$)");
-
-    while (getline(fileReader, currentLine)) {
-        bool labelSingle = false;
-        std::string lineWithoutComments;
-        std::string comment;
-        std::string label;
-        std::vector<std::string> result = {};
-        std::string labelCall;
-        if (std::regex_search(currentLine, match, regex1)) {
-            comment = match.str(1);
+int assembleBatch(const Options &options, std::ostream &err) {
+    static const char *const extensions[] = {".hex", ".bin", ".bin", ".ihex", ".vmem"};
+    const char *extension = options.object ? ".o" : extensions[options.imageFormat];
+
+    size_t input_cnt = options.inputs.size();
+    std::vector<Diagnostics> diagnostics;
+    for (const auto &input: options.inputs) diagnostics.emplace_back(input, options.maxErrors);
+    std::vector<AssemblerStats> stats(options.stats ? input_cnt : 0);
+    runParallel(input_cnt, options.jobs, [&](size_t i) {
+        Options file_options = options;
+        file_options.input = options.inputs[i];
+        file_options.instructions = file_options.input + extension;
+        if (options.listings) file_options.listing = file_options.input + ".lst";
+        file_options.jobs = 1;  // the files are already assembled in parallel
+        Assembler assembler;
+        bool success = assembleFile(file_options, assembler, diagnostics[i], options.stats ? &stats[i] : nullptr);
+        if (success && !assembler.data().empty()) {
+            std::string data_path = file_options.input + ".data" + extension;
+            writeImageFile(file_options, data_path, assembler.data(), diagnostics[i]);
         }
-        // Looking for lines with codes
-        if (std::regex_search(currentLine, regex2)) {
-            // Looking for code without comments (we keep everything before a #)
-            if (std::regex_search(currentLine, match, regex3)) {
-                lineWithoutComments = match.str(0);
-                // Looking for a label name
-                if (std::regex_search(lineWithoutComments, match, regex4)) {
-                    label = match.str(0);
-                    // Looking if there is no code after the label
-                    if (!std::regex_search(lineWithoutComments, regex5)) {
-                        labelSingle = true;
-                    }
-                    lineWithoutComments = std::regex_replace(lineWithoutComments, regex6, "");
-                }
-                if (std::regex_search(lineWithoutComments, match, firstMatch)) {
-                    result = {match.str(1)};
-                } else if (std::regex_search(lineWithoutComments, match, secondMatch)) {
-                    if (match.str(1) == "j") {
-                        auto converted_string = strtoi_safe(match.str(2));
-                        if(converted_string.first){ // input is already integer
-                            result = {match.str(1), std::to_string(converted_string.second)};
-                        }else{ // input is a label
-                            auto map_result = labelAddrMap.find(match.str(2));
-                            if (map_result == labelAddrMap.end()) {
-                                outputListing << "Error: label '" << match.str(2)
-                                            << "' does not exist!" << std::endl;
-                                outputListing.close();
-                                exit(EXIT_FAILURE);
-                            }
-                            result = {match.str(1), std::to_string(map_result->second / 4)};
-                            labelCall = match.str(2);
-                        }
-                    } else {
-                        result = {match.str(1), match.str(2)};
-                    }
-                } else if (std::regex_search(lineWithoutComments, match, thirdMatch)) {
-                    result = {match.str(1), match.str(2), match.str(4), match.str(3)};
-                }
-                else if (std::regex_search(lineWithoutComments, match, fourthMatch)) {
-                    result = {match.str(1), match.str(2), match.str(4), match.str(3)};
-                } else if (std::regex_search(lineWithoutComments, match, fifthMatch)) {
-                    if (match.str(1) == "beq") {
-                        auto converted_string = strtoi_safe(match.str(4));
-
-                        if(converted_string.second > 0xFFFF){
-                            outputListing << "Error: Argument too long.\n";
-                            outputListing.close();
-                            exit(EXIT_FAILURE);
-                        }
-
-                        if(converted_string.first){ // input is already integer
-                            result = {
-                                match.str(1),
-                                match.str(3),  // special order for beq and bne
-                                match.str(2),
-                                std::to_string(converted_string.second)
-                            };
-                        }else{ // input is a label
-                            auto map_result = labelAddrMap.find(match.str(4));
-                            if (map_result == labelAddrMap.end()) {
-                                outputListing << "Error: label '" << match.str(4)
-                                            << "' does not exist!" << std::endl;
-                                outputListing.close();
-                                exit(EXIT_FAILURE);
-                            }
-                            result = {
-                                    match.str(1),
-                                    match.str(3),  // special order for beq and bne
-                                    match.str(2),
-                                    std::to_string((map_result->second - instruction_count - 4) / 4)
-                            };
-                            labelCall = match.str(4);
-                        }
-                    } else {
-                        result = {match.str(1), match.str(2), match.str(3), match.str(4)};
-                    }
-                } else if (label.empty()) {
-                    result = {"err"};
-                }
-            }
-        }
-        outputPrinting(outputListing, outputInstructions, result, comment, label, labelCall, instruction_count, labelSingle);
+    });
+
+    writeDiagnostics(options, diagnostics, err);
+    if (options.stats) {
+        AssemblerStats total;
+        for (const auto &file: stats) total.add(file);
+        writeStats(options, total, err);
     }
-    symbolsOutputPrinting(outputListing, labelAddrMap);
+    return static_cast<int>(std::count_if(diagnostics.begin(), diagnostics.end(),
+                                          [](const Diagnostics &file) { return file.hasErrors(); }));
 }
 
 // --------------------------------------------------------
 
-int main(int argc, char* argv[]) {
-    // call like "./executable inputfile output_listing output_instructions"
-    if(argc != 4){
+/**
+ * @brief Executes one command line.
+ *
+ * @param program name of the program for the usage
+ * @param args arguments without the program name
+ * @param out receives the output of the simulator
+ * @param err receives the usage and diagnostics
+ * @return int exit code
+ */
+int runCommand(const char *program, const std::vector<std::string> &args, std::ostream &out, std::ostream &err) {
+    for (const auto &arg: args) {
+        if (arg == "-h" || arg == "--help") {
+            printUsage(err, program);
+            return 0;
+        }
+    }
+
+    Options options;
+    if (!parseOptions(args, options)) {
+        printUsage(err, program);
         return 1;
     }
 
-    // open files
-    std::ifstream fileReader(argv[1]);
-    std::ofstream outputListing(argv[2]);
-    std::ofstream outputInstructions(argv[3]);
-    if(!fileReader.is_open() || !outputInstructions.is_open() || ! outputListing.is_open()){
+    if (!options.serve.empty()) {
+        // every request runs in the same process, so all tables stay warm
+        RequestHandler handler = [program](const std::vector<std::string> &request, std::ostream &reply) {
+            // "-" reads the stdin of the server, as input and as the value
+            // of any option, e.g. "--manifest=-" or "--cache -"
+            for (const auto &arg: request) {
+                bool stdin_value = arg == "-" || (arg.rfind("--", 0) == 0 && arg.size() > 3 &&
+                                                  arg.compare(arg.size() - 2, 2, "=-") == 0);
+                if (stdin_value || arg == "--serve" || arg.rfind("--serve=", 0) == 0) {
+                    reply << "stdin and --serve can't be used in a request\n";
+                    return 1;
+                }
+            }
+            return runCommand(program, request, reply, reply);
+        };
+        std::string error;
+        serve(options.serve, handler, options.jobs, error);
+        err << error << "\n";
         return 1;
     }
 
-    std::map<std::string, int> labelAddrMap;
+    if (options.batch) {
+        return assembleBatch(options, err) == 0 ? 0 : 1;
+    }
 
-    firstPass(fileReader, labelAddrMap);
-    secondPass(fileReader, outputListing, outputInstructions, labelAddrMap);
-    fileReader.close();
-    outputListing.close();
-    outputInstructions.close();
-    return 0;
+    if (options.link) {
+        std::vector<Diagnostics> diagnostics;
+        std::vector<uint32_t> words;
+        std::vector<uint8_t> data;
+        AssemblerStats stats;
+        bool success = linkFiles(options, words, data, diagnostics, options.stats ? &stats : nullptr);
+        writeDiagnostics(options, diagnostics, err);
+        if (options.stats) writeStats(options, stats, err);
+        if (!success) return 1;
+        return options.run ? runProgram(options, words, data, out) : 0;
+    }
+
+    std::vector<Diagnostics> diagnostics;
+    diagnostics.emplace_back(options.input, options.maxErrors);
+    Assembler assembler;
+    AssemblerStats stats;
+    bool success = assembleFile(options, assembler, diagnostics[0], options.stats ? &stats : nullptr);
+    writeDiagnostics(options, diagnostics, err);
+    if (options.stats) writeStats(options, stats, err);
+    if (!success) return 1;
+
+    return options.run ? runProgram(options, assembler.words(), assembler.data(), out) : 0;
+}
+
+// --------------------------------------------------------
+
+int main(int argc, char* argv[]) {
+    return runCommand(argv[0], std::vector<std::string>(argv + 1, argv + argc), std::cout, std::cerr);
 }
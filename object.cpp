@@ -0,0 +1,224 @@
+#include "object.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+#include "assembler.hpp"
+#include "directives.hpp"
+#include "instruction.hpp"
+#include "source.hpp"
+#include "symbols.hpp"
+
+namespace {
+
+static_assert(std::is_trivially_copyable_v<ObjectSymbol> && std::is_trivially_copyable_v<Relocation>,
+              "symbols and relocations are stored as they are");
+
+// changes whenever the layout of the file, of ObjectSymbol or of Relocation changes
+constexpr std::string_view OBJECT_MAGIC = "MIPSOB02";
+
+/**
+ * @brief Layout of the beginning of an object file. The words, the data, the
+ * symbols, the relocations and the strings follow it.
+ */
+struct ObjectHeader {
+    char magic[8];
+    uint64_t wordCount;
+    uint64_t dataSize;
+    uint64_t symbolCount;
+    uint64_t relocationCount;
+    uint64_t stringSize;
+    uint64_t sourceSize;
+};
+
+/**
+ * @brief Copies count records from the data at pos and moves pos behind them.
+ */
+template <typename T>
+void readRecords(std::string_view data, size_t &pos, std::vector<T> &records, size_t count) {
+    records.resize(count);
+    std::memcpy(records.data(), data.data() + pos, count * sizeof(T));
+    pos += count * sizeof(T);
+}
+
+template <typename T>
+void writeRecords(std::ofstream &file, const std::vector<T> &records) {
+    file.write(reinterpret_cast<const char *>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(T)));
+}
+
+}  // namespace
+
+// --------------------------------------------------------
+
+bool ObjectFile::load(const std::string &path) {
+    clear();
+    SourceFile file;
+    if (!file.open(path)) return false;
+
+    std::string_view data = file.text();
+    ObjectHeader header;
+    if (data.size() < sizeof(header)) return false;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::string_view(header.magic, sizeof(header.magic)) != OBJECT_MAGIC) return false;
+
+    // the counts must add up to the size of the file
+    uint64_t size_left = data.size() - sizeof(header);
+    auto take = [&](uint64_t count, size_t record_size) {
+        if (count > size_left / record_size) return false;
+        size_left -= count * record_size;
+        return true;
+    };
+    if (!take(header.wordCount, sizeof(uint32_t)) || !take(header.dataSize, 1) ||
+        !take(header.symbolCount, sizeof(ObjectSymbol)) ||
+        !take(header.relocationCount, sizeof(Relocation)) || size_left != header.stringSize ||
+        header.sourceSize > header.stringSize) {
+        return false;
+    }
+
+    size_t pos = sizeof(header);
+    readRecords(data, pos, words, header.wordCount);
+    readRecords(data, pos, this->data, header.dataSize);
+    readRecords(data, pos, symbols, header.symbolCount);
+    readRecords(data, pos, relocations, header.relocationCount);
+    strings_.assign(data.substr(pos));
+    sourceSize_ = static_cast<uint32_t>(header.sourceSize);
+
+    bool consistent =
+        std::all_of(symbols.begin(), symbols.end(),
+                    [&](const ObjectSymbol &symbol) {
+                        return uint64_t(symbol.name) + symbol.nameSize <= strings_.size();
+                    }) &&
+        std::all_of(relocations.begin(), relocations.end(), [&](const Relocation &relocation) {
+            return relocation.index < words.size() && relocation.symbol < symbols.size();
+        });
+    if (!consistent) clear();
+    return consistent;
+}
+
+// --------------------------------------------------------
+
+bool ObjectFile::save(const std::string &path) const {
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return false;
+
+    ObjectHeader header;
+    std::memcpy(header.magic, OBJECT_MAGIC.data(), sizeof(header.magic));
+    header.wordCount = words.size();
+    header.dataSize = data.size();
+    header.symbolCount = symbols.size();
+    header.relocationCount = relocations.size();
+    header.stringSize = strings_.size();
+    header.sourceSize = sourceSize_;
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    writeRecords(file, words);
+    writeRecords(file, data);
+    writeRecords(file, symbols);
+    writeRecords(file, relocations);
+    file.write(strings_.data(), static_cast<std::streamsize>(strings_.size()));
+    return static_cast<bool>(file);
+}
+
+// --------------------------------------------------------
+
+void ObjectFile::clear(std::string_view source) {
+    words.clear();
+    data.clear();
+    symbols.clear();
+    relocations.clear();
+    strings_.assign(source.data(), source.size());
+    sourceSize_ = static_cast<uint32_t>(source.size());
+}
+
+// --------------------------------------------------------
+
+uint32_t ObjectFile::addSymbol(std::string_view name, int address, uint32_t flags) {
+    ObjectSymbol symbol;
+    symbol.name = static_cast<uint32_t>(strings_.size());
+    symbol.nameSize = static_cast<uint32_t>(name.size());
+    symbol.address = address;
+    symbol.flags = flags;
+    strings_.append(name.data(), name.size());
+    symbols.push_back(symbol);
+    return static_cast<uint32_t>(symbols.size() - 1);
+}
+
+// --------------------------------------------------------
+
+bool linkObjects(const std::vector<ObjectFile> &objects,
+                 std::vector<uint32_t> &words,
+                 std::vector<uint8_t> &data,
+                 std::vector<Diagnostics> &diagnostics,
+                 unsigned jobs) {
+    // place the objects and collect the labels they define
+    constexpr uint64_t data_alignment = uint64_t(1) << MAX_DATA_ALIGNMENT;
+    std::vector<int> base(objects.size());
+    std::vector<int> data_base(objects.size());
+    SymbolTable globals;     // address of every label
+    SymbolTable duplicates;  // labels that are defined by more than one object
+    size_t word_cnt = 0;
+    uint64_t data_size = 0;
+    for (size_t i = 0; i < objects.size(); ++i) {
+        base[i] = static_cast<int>(4 * word_cnt);
+        word_cnt += objects[i].words.size();
+        data_size = (data_size + data_alignment - 1) & ~(data_alignment - 1);
+        data_base[i] = static_cast<int>(data_size);
+        data_size += objects[i].data.size();
+        if (data_size > MAX_DATA_SIZE) {
+            diagnostics[i].report(0, 0, SEVERITY_ERROR, "Data segment too large.");
+            return false;
+        }
+        for (const ObjectSymbol &symbol: objects[i].symbols) {
+            if (!(symbol.flags & OBJECT_SYMBOL_DEFINED)) continue;
+            std::string_view name = objects[i].name(symbol);
+            if (globals.find(name)) duplicates.set(name, 0);
+            bool data_symbol = symbol.flags & OBJECT_SYMBOL_DATA;
+            globals.set(name, (data_symbol ? data_base[i] : base[i]) + symbol.address,
+                        data_symbol ? SEGMENT_DATA : SEGMENT_TEXT);
+        }
+    }
+
+    // the tables are only read from here on, so the objects are patched concurrently
+    words.resize(word_cnt);
+    data.assign(data_size, 0);
+    runParallel(objects.size(), jobs, [&](size_t i) {
+        const ObjectFile &object = objects[i];
+        uint32_t *out = words.data() + base[i] / 4;
+        std::copy(object.words.begin(), object.words.end(), out);
+        std::copy(object.data.begin(), object.data.end(), data.begin() + data_base[i]);
+        uint32_t error_line = 0;  // both halves of la refer to the label, the line is reported once
+        for (const Relocation &relocation: object.relocations) {
+            if (diagnostics[i].limitReached()) break;
+            const ObjectSymbol &symbol = object.symbols[relocation.symbol];
+            std::string_view name = object.name(symbol);
+            Instruction instruction;
+            try {
+                SymbolTable::Symbol target{name, 0, 0, SEGMENT_TEXT};
+                if (symbol.flags & OBJECT_SYMBOL_DEFINED) {
+                    bool data_symbol = symbol.flags & OBJECT_SYMBOL_DATA;
+                    target.address = (data_symbol ? data_base[i] : base[i]) + symbol.address;
+                    target.segment = data_symbol ? SEGMENT_DATA : SEGMENT_TEXT;
+                } else if (duplicates.find(name)) {
+                    throw AssemblerError(std::string("label '") + std::string(name) + "' is defined in more than one object!");
+                } else if (const SymbolTable::Symbol *global = globals.findSymbol(name)) {
+                    target = *global;
+                } else {
+                    throw AssemblerError(std::string("label '") + std::string(name) + "' does not exist!");
+                }
+                if (!decodeInstruction(out[relocation.index], instruction)) {
+                    throw AssemblerError("Relocated word is not an instruction.");
+                }
+                instruction.immediate = symbolTarget(instruction.opcode, target, base[i] + 4 * static_cast<int>(relocation.index));
+                checkImmediate(instruction, name);
+            } catch (const AssemblerError &e) {
+                if (relocation.line != error_line) diagnostics[i].report(relocation.line, 0, SEVERITY_ERROR, e.what());
+                error_line = relocation.line;
+                continue;
+            }
+            out[relocation.index] = encodeInstruction(instruction);
+        }
+    });
+
+    return std::none_of(diagnostics.begin(), diagnostics.end(), [](const Diagnostics &object) { return object.hasErrors(); });
+}
@@ -0,0 +1,110 @@
+#ifndef MIPS_OBJECT_H
+#define MIPS_OBJECT_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "diagnostics.hpp"
+
+// flags of an ObjectSymbol
+enum {
+    OBJECT_SYMBOL_DEFINED = 1,  // the label is defined in the object, otherwise in another one
+    OBJECT_SYMBOL_DATA = 2      // the address is in the data segment
+};
+
+/**
+ * @brief Label that is defined in an object or that its instructions refer
+ * to. The symbols are stored in the object file as they are.
+ */
+struct ObjectSymbol {
+    uint32_t name = 0;  // see ObjectFile::name
+    uint32_t nameSize = 0;
+    int32_t address = 0;  // from the start of the object's words or data, 0 if not defined
+    uint32_t flags = 0;   // OBJECT_SYMBOL_*
+};
+
+/**
+ * @brief Word that is patched when the objects are linked. What is patched
+ * follows from the instruction, see labelTarget: the target of a jump, the
+ * half of an address for lui and ori, or the offset of a branch to a label
+ * of another object.
+ */
+struct Relocation {
+    uint32_t index = 0;   // index of the word in the object
+    uint32_t symbol = 0;  // index into the symbols
+    uint32_t line = 0;    // source line of the instruction, for the errors
+};
+
+/**
+ * @brief Relocatable result of assembling one source, see objectPasses. The
+ * words are encoded as if the object and its data started at address 0 and
+ * the labels of other objects were at address 0.
+ */
+class ObjectFile {
+   public:
+    std::vector<uint32_t> words;
+    std::vector<uint8_t> data;  // data segment, see directives.hpp
+    std::vector<ObjectSymbol> symbols;  // the defined labels come first
+    std::vector<Relocation> relocations;
+
+    /**
+     * @brief Replaces the contents with the object stored in a file.
+     *
+     * @return true, if the file exists, was written by this version and is
+     * consistent
+     */
+    bool load(const std::string &path);
+
+    /**
+     * @return true, if the file was written completely
+     */
+    bool save(const std::string &path) const;
+
+    /**
+     * @brief Removes the contents, the memory is kept.
+     *
+     * @param source name of the source in the diagnostics of the linker
+     */
+    void clear(std::string_view source = "");
+
+    /**
+     * @return uint32_t index of the new symbol
+     */
+    uint32_t addSymbol(std::string_view name, int address, uint32_t flags);
+
+    std::string_view name(const ObjectSymbol &symbol) const {
+        return std::string_view(strings_).substr(symbol.name, symbol.nameSize);
+    }
+
+    std::string_view source() const { return std::string_view(strings_).substr(0, sourceSize_); }
+
+   private:
+    std::string strings_;  // name of the source followed by the names of the symbols
+    uint32_t sourceSize_ = 0;
+};
+
+/**
+ * @brief Links objects into one program. The objects are placed one after
+ * another in the given order, the first one at address 0. Their data is
+ * placed the same way in the data segment, each at a multiple of
+ * 2^MAX_DATA_ALIGNMENT bytes so the alignments within it hold. A label that
+ * an object doesn't define is taken from the other objects, it must be
+ * defined in exactly one of them. The objects are patched in parallel.
+ *
+ * @param objects the objects in the order of their addresses
+ * @param words receives the program
+ * @param data receives the data segment
+ * @param diagnostics one per object, receive the labels that can't be
+ * resolved and the targets that are out of range
+ * @param jobs maximum number of threads, 0 for one per hardware thread
+ * @return true, if all relocations were applied
+ */
+bool linkObjects(const std::vector<ObjectFile> &objects,
+                 std::vector<uint32_t> &words,
+                 std::vector<uint8_t> &data,
+                 std::vector<Diagnostics> &diagnostics,
+                 unsigned jobs);
+
+#endif
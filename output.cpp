@@ -0,0 +1,196 @@
+#include "output.hpp"
+
+#include <algorithm>
+
+#include "directives.hpp"
+
+namespace {
+
+const char HEX_DIGITS[] = "0123456789abcdef";
+const char HEX_DIGITS_UPPER[] = "0123456789ABCDEF";  // Intel HEX
+
+void formatHex(char *dest, uint32_t value) {
+    for (int i = 7; i >= 0; --i) {
+        dest[i] = HEX_DIGITS[value & 0xF];
+        value >>= 4;
+    }
+}
+
+/**
+ * @brief Appends one Intel HEX record including its checksum.
+ */
+void appendHexRecord(OutputBuffer &out, uint8_t type, uint16_t address, const uint8_t *data, size_t length) {
+    uint8_t header[4] = {static_cast<uint8_t>(length),
+                         static_cast<uint8_t>(address >> 8),
+                         static_cast<uint8_t>(address),
+                         type};
+    uint8_t checksum = 0;
+    char record[2 * (4 + 255 + 1) + 2];
+    size_t pos = 0;
+    auto put_byte = [&](uint8_t b) {
+        record[pos++] = HEX_DIGITS_UPPER[b >> 4];
+        record[pos++] = HEX_DIGITS_UPPER[b & 0xF];
+        checksum += b;
+    };
+
+    for (uint8_t b: header) put_byte(b);
+    for (size_t i = 0; i < length; ++i) put_byte(data[i]);
+    put_byte(static_cast<uint8_t>(-checksum));
+    record[pos++] = '\n';
+    out << ':' << std::string_view(record, pos);
+}
+
+/**
+ * @brief Writes count words in the given format, see writeImage.
+ *
+ * @param word returns the word at an index
+ */
+template <class WordAt>
+void writeWords(std::ostream &out, size_t count, WordAt word, int format) {
+    OutputBuffer buffer(out);
+
+    switch (format) {
+        case IMAGE_FORMAT_HEX:
+            for (size_t i = 0; i < count; ++i) {
+                buffer << "0x";
+                buffer.appendHex(word(i));
+                buffer << '\n';
+            }
+            break;
+
+        case IMAGE_FORMAT_VMEM:
+            for (size_t i = 0; i < count; ++i) {
+                buffer.appendHex(word(i));
+                buffer << '\n';
+            }
+            break;
+
+        case IMAGE_FORMAT_BIN_LE:
+        case IMAGE_FORMAT_BIN_BE:
+            for (size_t i = 0; i < count; ++i) {
+                uint32_t value = word(i);
+                char bytes[4];
+                for (int j = 0; j < 4; ++j) {
+                    int shift = format == IMAGE_FORMAT_BIN_LE ? 8 * j : 24 - 8 * j;
+                    bytes[j] = static_cast<char>(value >> shift);
+                }
+                buffer << std::string_view(bytes, 4);
+            }
+            break;
+
+        case IMAGE_FORMAT_IHEX: {
+            // 16 data bytes per record, an extended linear address record
+            // whenever the upper 16 address bits change
+            uint8_t data[16];
+            uint32_t upper_address = 0;
+            for (size_t first = 0; first < count; first += 4) {
+                uint32_t address = static_cast<uint32_t>(first * 4);
+                if ((address >> 16) != upper_address) {
+                    upper_address = address >> 16;
+                    uint8_t upper[2] = {static_cast<uint8_t>(upper_address >> 8),
+                                        static_cast<uint8_t>(upper_address)};
+                    appendHexRecord(buffer, 0x04, 0, upper, 2);
+                }
+
+                size_t length = 0;
+                for (size_t i = first; i < count && i < first + 4; ++i) {
+                    uint32_t value = word(i);
+                    for (int shift = 24; shift >= 0; shift -= 8) {
+                        data[length++] = static_cast<uint8_t>(value >> shift);
+                    }
+                }
+                appendHexRecord(buffer, 0x00, static_cast<uint16_t>(address), data, length);
+            }
+            appendHexRecord(buffer, 0x01, 0, nullptr, 0);
+            break;
+        }
+    }
+}
+
+}  // namespace
+
+// --------------------------------------------------------
+
+OutputBuffer::OutputBuffer(std::ostream &out, size_t capacity)
+    : out_(&out)
+    , buffer_(ownBuffer_)
+    , capacity_(capacity) {
+    buffer_.reserve(capacity + 256);
+}
+
+OutputBuffer::OutputBuffer(std::string &text)
+    : out_(nullptr)
+    , buffer_(text)
+    , capacity_(SIZE_MAX) {
+    buffer_.clear();
+}
+
+OutputBuffer::~OutputBuffer() { flush(); }
+
+// --------------------------------------------------------
+
+void OutputBuffer::appendHex(uint32_t value) {
+    size_t pos = buffer_.size();
+    buffer_.resize(pos + 8);
+    formatHex(&buffer_[pos], value);
+    if (buffer_.size() >= capacity_) flush();
+}
+
+// --------------------------------------------------------
+
+void OutputBuffer::appendPadded(std::string_view s, size_t width) {
+    buffer_.append(s.data(), s.size());
+    if (s.size() < width) buffer_.append(width - s.size(), ' ');
+    if (buffer_.size() >= capacity_) flush();
+}
+
+// --------------------------------------------------------
+
+void OutputBuffer::patchHex(size_t offset, uint32_t value) {
+    char digits[8];
+    formatHex(digits, value);
+
+    // the digits may be split between the stream and the buffer
+    for (size_t i = 0; i < 8; ++i) {
+        if (offset + i >= flushed_) buffer_[offset + i - flushed_] = digits[i];
+    }
+    if (offset < flushed_) {
+        size_t length = std::min<size_t>(8, flushed_ - offset);
+        out_->seekp(static_cast<std::streamoff>(offset));
+        out_->write(digits, static_cast<std::streamsize>(length));
+        out_->seekp(0, std::ios::end);
+    }
+}
+
+// --------------------------------------------------------
+
+void OutputBuffer::flush() {
+    if (!out_) return;
+    out_->write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    out_->flush();
+    flushed_ += buffer_.size();
+    buffer_.clear();
+}
+
+// --------------------------------------------------------
+
+int imageFormatFromName(std::string_view name) {
+    if (name == "hex") return IMAGE_FORMAT_HEX;
+    if (name == "bin-le") return IMAGE_FORMAT_BIN_LE;
+    if (name == "bin-be") return IMAGE_FORMAT_BIN_BE;
+    if (name == "ihex") return IMAGE_FORMAT_IHEX;
+    if (name == "vmem") return IMAGE_FORMAT_VMEM;
+    return -1;
+}
+
+// --------------------------------------------------------
+
+void writeImage(std::ostream &out, const std::vector<uint32_t> &words, int format) {
+    writeWords(out, words.size(), [&](size_t i) { return words[i]; }, format);
+}
+
+// --------------------------------------------------------
+
+void writeImage(std::ostream &out, const std::vector<uint8_t> &data, int format) {
+    writeWords(out, dataWordCount(data), [&](size_t i) { return dataWord(data, i); }, format);
+}
@@ -0,0 +1,129 @@
+#ifndef MIPS_OUTPUT_H
+#define MIPS_OUTPUT_H
+
+#include <charconv>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Formats text into a large preallocated buffer and writes it to the
+ * underlying stream in big blocks. Keeps track of the total amount of bytes
+ * written, so already written text can be patched later on.
+ */
+class OutputBuffer {
+   public:
+    explicit OutputBuffer(std::ostream &out, size_t capacity = 1 << 20);
+
+    /**
+     * @brief Formats into a string instead of a stream. The string is cleared
+     * but keeps its capacity, so it can be reused for the next output.
+     */
+    explicit OutputBuffer(std::string &text);
+    OutputBuffer(const OutputBuffer &) = delete;
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+    ~OutputBuffer();
+
+    OutputBuffer &operator<<(std::string_view s) {
+        buffer_.append(s.data(), s.size());
+        if (buffer_.size() >= capacity_) flush();
+        return *this;
+    }
+
+    OutputBuffer &operator<<(char c) {
+        buffer_.push_back(c);
+        if (buffer_.size() >= capacity_) flush();
+        return *this;
+    }
+
+    /**
+     * @brief Appends an integer in decimal notation.
+     */
+    template <typename T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
+    OutputBuffer &operator<<(T value) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        return *this << std::string_view(digits, result.ptr - digits);
+    }
+
+    /**
+     * @brief Appends a value as 8 lower case hex digits without prefix.
+     */
+    void appendHex(uint32_t value);
+
+    /**
+     * @brief Appends s left aligned and padded with blanks to at least width
+     * characters.
+     */
+    void appendPadded(std::string_view s, size_t width);
+
+    /**
+     * @brief Total amount of bytes written so far, including the ones that are
+     * still buffered.
+     */
+    size_t size() const { return flushed_ + buffer_.size(); }
+
+    /**
+     * @brief Overwrites 8 hex digits that were written before at the given
+     * offset. If the digits were already flushed, the underlying stream has to
+     * be seekable.
+     */
+    void patchHex(size_t offset, uint32_t value);
+
+    /**
+     * @brief Writes the buffered text and flushes the underlying stream. Does
+     * nothing when formatting into a string.
+     */
+    void flush();
+
+   private:
+    std::ostream *out_;  // nullptr when formatting into a string
+    std::string ownBuffer_;
+    std::string &buffer_;
+    size_t capacity_;
+    size_t flushed_ = 0;
+};
+
+// --------------------------------------------------------
+
+// formats of the file containing the instructions
+enum {
+    IMAGE_FORMAT_HEX,     // "0x" and 8 hex digits per line
+    IMAGE_FORMAT_BIN_LE,  // raw little endian words
+    IMAGE_FORMAT_BIN_BE,  // raw big endian words
+    IMAGE_FORMAT_IHEX,    // Intel HEX, big endian words
+    IMAGE_FORMAT_VMEM     // 8 hex digits per line for Verilog's $readmemh
+};
+
+/**
+ * @brief Converts the name of an image format as given on the command line.
+ *
+ * @param name one of "hex", "bin-le", "bin-be", "ihex" or "vmem"
+ * @return int IMAGE_FORMAT_*, -1 if the name is unknown
+ */
+int imageFormatFromName(std::string_view name);
+
+/**
+ * @brief Writes the encoded instructions in the given format. The stream
+ * should be opened in binary mode for the raw formats.
+ *
+ * @param out output stream for the file containing the instructions
+ * @param words encoded instructions, the first one is at address 0
+ * @param format IMAGE_FORMAT_*
+ */
+void writeImage(std::ostream &out, const std::vector<uint32_t> &words, int format);
+
+/**
+ * @brief Writes the data segment in the given format, packed into words as
+ * by dataWord without a copy of the segment.
+ *
+ * @param out output stream for the file containing the data
+ * @param data the data segment, the first byte is at address 0
+ * @param format IMAGE_FORMAT_*
+ */
+void writeImage(std::ostream &out, const std::vector<uint8_t> &data, int format);
+
+#endif
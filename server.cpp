@@ -0,0 +1,311 @@
+#include "server.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "assembler.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define MIPS_HAVE_UNIX_SOCKETS 1
+#endif
+
+#ifdef MIPS_HAVE_UNIX_SOCKETS
+
+namespace {
+
+// longest request line, a longer one is answered with an error and closes
+// the connection
+constexpr size_t MAX_REQUEST_LENGTH = 1 << 16;
+
+// a client that doesn't take its reply for this long loses the connection
+constexpr int REPLY_TIMEOUT_SECONDS = 10;
+
+/**
+ * @brief Splits a request line at tabs.
+ */
+std::vector<std::string> splitRequest(std::string_view line) {
+    std::vector<std::string> args;
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    while (!line.empty()) {
+        size_t tab = line.find('\t');
+        if (tab != 0) args.emplace_back(line.substr(0, tab));
+        if (tab == std::string_view::npos) break;
+        line.remove_prefix(tab + 1);
+    }
+    return args;
+}
+
+bool writeAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t written = ::write(fd, data.data(), data.size());
+        if (written <= 0) return false;
+        data.remove_prefix(static_cast<size_t>(written));
+    }
+    return true;
+}
+
+std::string replyHeader(int code, size_t size) {
+    return std::to_string(code) + " " + std::to_string(size) + "\n";
+}
+
+/**
+ * @brief Connection of a client. While a worker answers its request, only
+ * the worker touches request and failed, the poll loop leaves it alone.
+ */
+struct Connection {
+    int fd = -1;
+    std::string buffer;   // received bytes after the last complete line
+    std::string request;  // line that is answered
+    bool busy = false;    // a worker answers request
+    bool failed = false;  // the reply couldn't be written
+};
+
+/**
+ * @brief Requests that the poll loop hands to the workers and the connections
+ * that the workers hand back. The loop is woken up by a byte on a pipe.
+ */
+class RequestQueue {
+   public:
+    explicit RequestQueue(int wake) : wake_(wake) {}
+
+    void push(Connection *connection) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.push_back(connection);
+        }
+        ready_.notify_one();
+    }
+
+    /**
+     * @return Connection * next connection with a request, nullptr once the
+     * server stops
+     */
+    Connection *pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this]() { return stop_ || !pending_.empty(); });
+        if (stop_) return nullptr;
+        Connection *connection = pending_.front();
+        pending_.pop_front();
+        return connection;
+    }
+
+    void answered(Connection *connection) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            answered_.push_back(connection);
+        }
+        char byte = 0;
+        (void)!::write(wake_, &byte, 1);  // a full pipe wakes the loop as well
+    }
+
+    std::vector<Connection *> takeAnswered() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<Connection *> connections;
+        connections.swap(answered_);
+        return connections;
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        ready_.notify_all();
+    }
+
+   private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<Connection *> pending_;
+    std::vector<Connection *> answered_;
+    bool stop_ = false;
+    int wake_;
+};
+
+/**
+ * @brief Answers the requests that the poll loop hands out until the server
+ * stops.
+ */
+void answerRequests(RequestQueue &queue, const RequestHandler &handler) {
+    while (Connection *connection = queue.pop()) {
+        std::ostringstream out;
+        int code = handler(splitRequest(connection->request), out);
+        std::string output = out.str();
+        connection->failed =
+            !writeAll(connection->fd, replyHeader(code, output.size())) || !writeAll(connection->fd, output);
+        queue.answered(connection);
+    }
+}
+
+/**
+ * @brief Hands the next complete line of a connection to the workers.
+ *
+ * @return false, if the line is too long, the connection has to be closed
+ */
+bool dispatchRequest(Connection &connection, RequestQueue &queue) {
+    size_t end = connection.buffer.find('\n');
+    if (end == std::string::npos ? connection.buffer.size() > MAX_REQUEST_LENGTH : end > MAX_REQUEST_LENGTH) {
+        std::string message = "request longer than " + std::to_string(MAX_REQUEST_LENGTH) + " bytes\n";
+        std::string reply = replyHeader(1, message.size()) + message;
+        ::send(connection.fd, reply.data(), reply.size(), MSG_DONTWAIT);  // the connection is closed anyway
+        return false;
+    }
+    if (end == std::string::npos) return true;
+
+    connection.request.assign(connection.buffer, 0, end);
+    connection.buffer.erase(0, end + 1);
+    connection.busy = true;
+    queue.push(&connection);
+    return true;
+}
+
+}  // namespace
+
+// --------------------------------------------------------
+
+bool serve(const std::string &path, const RequestHandler &handler, unsigned jobs, std::string &error) {
+    if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        error = "socket path too long: " + path;
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    std::signal(SIGPIPE, SIG_IGN);  // clients may go away before the reply
+    int server = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) {
+        error = std::string("can't create socket: ") + std::strerror(errno);
+        return false;
+    }
+    ::unlink(path.c_str());
+    if (::bind(server, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::listen(server, 64) != 0) {
+        error = "can't listen on " + path + ": " + std::strerror(errno);
+        ::close(server);
+        return false;
+    }
+
+    int wake[2];
+    if (::pipe(wake) != 0) {
+        error = std::string("can't create pipe: ") + std::strerror(errno);
+        ::close(server);
+        return false;
+    }
+    for (int fd: wake) ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    // one thread polls the socket and all connections and hands every
+    // complete request line to the workers, so idle connections hold no
+    // worker; a connection isn't polled while its request is answered, which
+    // keeps the replies in order
+    RequestQueue queue(wake[1]);
+    std::vector<std::unique_ptr<Connection>> connections;
+    runParallel(jobs + 1, jobs + 1, [&](size_t task) {
+        if (task != 0) {
+            answerRequests(queue, handler);
+            return;
+        }
+
+        std::vector<pollfd> fds;
+        std::vector<Connection *> polled;
+        auto accept_pause = std::chrono::steady_clock::time_point();
+        char chunk[1 << 16];
+        for (;;) {
+            bool accepting = std::chrono::steady_clock::now() >= accept_pause;
+            fds.assign({{wake[0], POLLIN, 0}, {accepting ? server : -1, POLLIN, 0}});
+            polled.clear();
+            for (const auto &connection: connections) {
+                if (connection->busy) continue;
+                fds.push_back({connection->fd, POLLIN, 0});
+                polled.push_back(connection.get());
+            }
+            if (::poll(fds.data(), fds.size(), accepting ? -1 : 100) < 0) {
+                if (errno == EINTR) continue;
+                error = std::string("can't poll on ") + path + ": " + std::strerror(errno);
+                break;
+            }
+
+            if (fds[0].revents != 0) {
+                while (::read(wake[0], chunk, sizeof(chunk)) > 0) {
+                }
+                for (Connection *connection: queue.takeAnswered()) {
+                    connection->busy = false;
+                    if (!connection->failed && !dispatchRequest(*connection, queue)) connection->failed = true;
+                }
+            }
+
+            for (size_t i = 0; i < polled.size(); ++i) {
+                Connection &connection = *polled[i];
+                if (fds[i + 2].revents == 0) continue;
+                ssize_t length = ::read(connection.fd, chunk, sizeof(chunk));
+                if (length > 0) {
+                    connection.buffer.append(chunk, static_cast<size_t>(length));
+                    if (dispatchRequest(connection, queue)) continue;
+                }
+                connection.failed = true;
+            }
+            // closed connections, or ones whose reply failed
+            for (auto &connection: connections) {
+                if (connection->busy || !connection->failed) continue;
+                ::close(connection->fd);
+                connection.reset();
+            }
+            connections.erase(std::remove(connections.begin(), connections.end(), nullptr), connections.end());
+
+            if (fds[1].revents == 0) continue;
+            int client = ::accept(server, nullptr, nullptr);
+            if (client >= 0) {
+                timeval timeout{REPLY_TIMEOUT_SECONDS, 0};
+                ::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                connections.push_back(std::make_unique<Connection>());
+                connections.back()->fd = client;
+                continue;
+            }
+            int accept_error = errno;
+            if (accept_error == EINTR || accept_error == ECONNABORTED || accept_error == EPROTO ||
+                accept_error == EAGAIN || accept_error == EWOULDBLOCK) {
+                continue;
+            }
+            if (accept_error == EMFILE || accept_error == ENFILE || accept_error == ENOBUFS || accept_error == ENOMEM) {
+                // stop accepting for a while until a connection is closed
+                // instead of spinning
+                accept_pause = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+                continue;
+            }
+            error = std::string("can't accept on ") + path + ": " + std::strerror(accept_error);
+            break;
+        }
+        queue.stop();
+    });
+
+    for (const auto &connection: connections) ::close(connection->fd);
+    ::close(wake[0]);
+    ::close(wake[1]);
+    ::close(server);
+    return false;
+}
+
+#else
+
+bool serve(const std::string &path, const RequestHandler &, unsigned, std::string &error) {
+    error = "server mode needs Unix domain sockets, can't listen on " + path;
+    return false;
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef MIPS_SERVER_H
+#define MIPS_SERVER_H
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Handles one request of the server.
+ *
+ * @param args command line arguments of the request, without program name
+ * @param out receives everything the request prints
+ * @return int exit code of the request
+ */
+using RequestHandler = std::function<int(const std::vector<std::string> &args, std::ostream &out)>;
+
+/**
+ * @brief Listens on a Unix domain socket and hands each request to handler,
+ * so all state that the process built up stays warm between requests. A
+ * request is one line of arguments separated by tabs. The reply is the line
+ * "<exit code> <size>" followed by size bytes of output. A connection may send
+ * any number of requests, they are answered in order. One thread polls the
+ * connections and hands every complete request to a fixed number of worker
+ * threads, so open connections without a request hold no thread. A request
+ * line longer than 64 KiB is answered with an error and closes the
+ * connection, and so does a reply that the client doesn't read for 10 s.
+ *
+ * @param path path of the socket, an existing file is replaced
+ * @param handler called for every request, possibly from several threads
+ * @param jobs number of worker threads, 0 for one per hardware thread
+ * @param error receives the reason, if the socket can't be opened or
+ * polling or accepting a connection fails
+ * @return bool false, if the socket can't be opened or polling or accepting fails,
+ * otherwise the function doesn't return
+ */
+bool serve(const std::string &path, const RequestHandler &handler, unsigned jobs, std::string &error);
+
+#endif
@@ -0,0 +1,338 @@
+#include "simulator.hpp"
+
+#include <algorithm>
+
+#include "directives.hpp"
+#include "output.hpp"
+
+namespace {
+
+// opcodes of the decoded program besides INSTR_*
+constexpr uint8_t OPCODE_INVALID = 0xFE;  // immediate holds the word
+constexpr uint8_t OPCODE_END = 0xFF;      // behind the last instruction
+
+std::string hexString(uint32_t value) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    std::string s = "0x00000000";
+    for (int i = 9; i >= 2; --i, value >>= 4) s[i] = HEX_DIGITS[value & 0xF];
+    return s;
+}
+
+}  // namespace
+
+// --------------------------------------------------------
+
+Simulator::Simulator(const std::vector<uint32_t> &image, const std::vector<uint8_t> &data, size_t memorySize)
+    : memory_(std::max(memorySize / 4, dataWordCount(data))) {
+    for (size_t i = 0; i < dataWordCount(data); ++i) memory_[i] = dataWord(data, i);
+    program_.resize(image.size() + 1);
+    for (size_t i = 0; i < image.size(); ++i) {
+        if (!decodeInstruction(image[i], program_[i])) {
+            program_[i].opcode = OPCODE_INVALID;
+            program_[i].immediate = static_cast<int32_t>(image[i]);
+        }
+    }
+    program_.back().opcode = OPCODE_END;
+}
+
+// --------------------------------------------------------
+
+int Simulator::run(uint64_t maxSteps) {
+    const Instruction *program = program_.data();
+    const size_t program_size = program_.size() - 1;
+    uint32_t *regs = registers_;
+    uint32_t *memory = memory_.data();
+    const uint32_t memory_size = static_cast<uint32_t>(memory_.size() * 4);
+    size_t index = pc_ / 4;  // of the next instruction
+    uint64_t steps = steps_;
+    const uint64_t limit = maxSteps == 0 ? UINT64_MAX : steps + maxSteps;
+    int stop = SIM_STOP_ERROR;
+
+    // a jump target must be an instruction or the end of the program
+    auto jump = [&](uint32_t address) {
+        if ((address & 3) != 0 || address / 4 > program_size) {
+            error_ = "jump to invalid address " + hexString(address);
+            return false;
+        }
+        index = address / 4;
+        return true;
+    };
+    // branch relative to the next instruction
+    auto branch = [&](const Instruction &instruction) {
+        return jump(static_cast<uint32_t>((index + instruction.immediate) * 4));
+    };
+    // address in the data memory of an access of size bytes, memory_size if
+    // it is invalid
+    auto data_address = [&](const Instruction &instruction, uint32_t size) {
+        uint32_t address = regs[instruction.rs] + static_cast<uint32_t>(instruction.immediate);
+        if ((address & (size - 1)) != 0 || address >= memory_size) {
+            error_ = "invalid data address " + hexString(address);
+            return memory_size;
+        }
+        return address;
+    };
+    // bytes and halfwords are little endian within the words
+    auto load = [&](uint32_t address, uint32_t size) {
+        uint32_t shift = 8 * (address & 3);
+        uint32_t mask = size == 4 ? ~0u : (1u << (8 * size)) - 1;
+        return (memory[address / 4] >> shift) & mask;
+    };
+    auto store = [&](uint32_t address, uint32_t size, uint32_t value) {
+        uint32_t shift = 8 * (address & 3);
+        uint32_t mask = (size == 4 ? ~0u : (1u << (8 * size)) - 1) << shift;
+        memory[address / 4] = (memory[address / 4] & ~mask) | ((value << shift) & mask);
+    };
+
+    for (;; ++steps) {
+        if (steps == limit) {
+            stop = SIM_STOP_LIMIT;
+            goto finished;
+        }
+
+        const Instruction &instruction = program[index++];
+        const uint32_t rs = regs[instruction.rs];
+        const uint32_t rt = regs[instruction.rt];
+        const uint32_t immediate = static_cast<uint32_t>(instruction.immediate);
+        switch (instruction.opcode) {
+            case INSTR_ADD:
+            case INSTR_ADDU:
+                regs[instruction.rd] = rs + rt;
+                break;
+            case INSTR_SUB:
+            case INSTR_SUBU:
+                regs[instruction.rd] = rs - rt;
+                break;
+            case INSTR_AND:
+                regs[instruction.rd] = rs & rt;
+                break;
+            case INSTR_OR:
+                regs[instruction.rd] = rs | rt;
+                break;
+            case INSTR_XOR:
+                regs[instruction.rd] = rs ^ rt;
+                break;
+            case INSTR_NOR:
+                regs[instruction.rd] = ~(rs | rt);
+                break;
+            case INSTR_SLT:
+                regs[instruction.rd] = static_cast<int32_t>(rs) < static_cast<int32_t>(rt);
+                break;
+            case INSTR_SLTU:
+                regs[instruction.rd] = rs < rt;
+                break;
+            case INSTR_SLL:
+                regs[instruction.rd] = rt << immediate;
+                break;
+            case INSTR_SRL:
+                regs[instruction.rd] = rt >> immediate;
+                break;
+            case INSTR_SRA:
+                regs[instruction.rd] = static_cast<uint32_t>(static_cast<int32_t>(rt) >> immediate);
+                break;
+            case INSTR_SLLV:
+                regs[instruction.rd] = rt << (rs & 31);
+                break;
+            case INSTR_SRLV:
+                regs[instruction.rd] = rt >> (rs & 31);
+                break;
+            case INSTR_SRAV:
+                regs[instruction.rd] = static_cast<uint32_t>(static_cast<int32_t>(rt) >> (rs & 31));
+                break;
+            case INSTR_MFHI:
+                regs[instruction.rd] = hi_;
+                break;
+            case INSTR_MTHI:
+                hi_ = rs;
+                break;
+            case INSTR_MFLO:
+                regs[instruction.rd] = lo_;
+                break;
+            case INSTR_MTLO:
+                lo_ = rs;
+                break;
+            case INSTR_MULT: {
+                uint64_t product = static_cast<uint64_t>(int64_t(static_cast<int32_t>(rs)) * static_cast<int32_t>(rt));
+                hi_ = static_cast<uint32_t>(product >> 32);
+                lo_ = static_cast<uint32_t>(product);
+                break;
+            }
+            case INSTR_MULTU: {
+                uint64_t product = uint64_t(rs) * rt;
+                hi_ = static_cast<uint32_t>(product >> 32);
+                lo_ = static_cast<uint32_t>(product);
+                break;
+            }
+            case INSTR_DIV:  // the result of a division by 0 is unpredictable, hi and lo are kept
+                if (rt != 0) {
+                    int64_t dividend = static_cast<int32_t>(rs);
+                    int64_t divisor = static_cast<int32_t>(rt);
+                    lo_ = static_cast<uint32_t>(dividend / divisor);
+                    hi_ = static_cast<uint32_t>(dividend % divisor);
+                }
+                break;
+            case INSTR_DIVU:
+                if (rt != 0) {
+                    lo_ = rs / rt;
+                    hi_ = rs % rt;
+                }
+                break;
+            case INSTR_MUL:
+                regs[instruction.rd] = rs * rt;
+                break;
+            case INSTR_LW:
+            case INSTR_LH:
+            case INSTR_LHU:
+            case INSTR_LB:
+            case INSTR_LBU: {
+                uint32_t size = instruction.opcode == INSTR_LW                                       ? 4
+                                : instruction.opcode == INSTR_LH || instruction.opcode == INSTR_LHU ? 2
+                                                                                                    : 1;
+                uint32_t address = data_address(instruction, size);
+                if (address == memory_size) goto stopped;
+                uint32_t value = load(address, size);
+                if (instruction.opcode == INSTR_LH) value = static_cast<uint32_t>(static_cast<int16_t>(value));
+                if (instruction.opcode == INSTR_LB) value = static_cast<uint32_t>(static_cast<int8_t>(value));
+                regs[instruction.rt] = value;
+                break;
+            }
+            case INSTR_SW:
+            case INSTR_SH:
+            case INSTR_SB: {
+                uint32_t size = instruction.opcode == INSTR_SW ? 4 : instruction.opcode == INSTR_SH ? 2 : 1;
+                uint32_t address = data_address(instruction, size);
+                if (address == memory_size) goto stopped;
+                store(address, size, rt);
+                break;
+            }
+            case INSTR_BEQ:
+                if (rs == rt && !branch(instruction)) goto stopped;
+                break;
+            case INSTR_BNE:
+                if (rs != rt && !branch(instruction)) goto stopped;
+                break;
+            case INSTR_BLEZ:
+                if (static_cast<int32_t>(rs) <= 0 && !branch(instruction)) goto stopped;
+                break;
+            case INSTR_BGTZ:
+                if (static_cast<int32_t>(rs) > 0 && !branch(instruction)) goto stopped;
+                break;
+            case INSTR_BLTZ:
+                if (static_cast<int32_t>(rs) < 0 && !branch(instruction)) goto stopped;
+                break;
+            case INSTR_BGEZ:
+                if (static_cast<int32_t>(rs) >= 0 && !branch(instruction)) goto stopped;
+                break;
+            case INSTR_BLTZAL:  // links even if the branch is not taken
+                regs[31] = static_cast<uint32_t>(index * 4);
+                if (static_cast<int32_t>(rs) < 0 && !branch(instruction)) goto stopped;
+                break;
+            case INSTR_BGEZAL:
+                regs[31] = static_cast<uint32_t>(index * 4);
+                if (static_cast<int32_t>(rs) >= 0 && !branch(instruction)) goto stopped;
+                break;
+            case INSTR_ADDI:
+            case INSTR_ADDIU:
+                regs[instruction.rt] = rs + immediate;
+                break;
+            case INSTR_SLTI:
+                regs[instruction.rt] = static_cast<int32_t>(rs) < instruction.immediate;
+                break;
+            case INSTR_SLTIU:
+                regs[instruction.rt] = rs < immediate;
+                break;
+            case INSTR_ANDI:  // logical immediates are zero extended
+                regs[instruction.rt] = rs & (immediate & 0xFFFF);
+                break;
+            case INSTR_ORI:
+                regs[instruction.rt] = rs | (immediate & 0xFFFF);
+                break;
+            case INSTR_XORI:
+                regs[instruction.rt] = rs ^ (immediate & 0xFFFF);
+                break;
+            case INSTR_LUI:
+                regs[instruction.rt] = immediate << 16;
+                break;
+            case INSTR_J:
+            case INSTR_JAL:
+                if (instruction.opcode == INSTR_JAL) regs[31] = static_cast<uint32_t>(index * 4);
+                if (!jump((static_cast<uint32_t>(index * 4) & 0xF0000000) | (immediate << 2))) goto stopped;
+                break;
+            case INSTR_JR:
+                if (!jump(rs)) goto stopped;
+                break;
+            case INSTR_JALR:
+                regs[instruction.rd] = static_cast<uint32_t>(index * 4);
+                if (!jump(rs)) goto stopped;
+                break;
+            case INSTR_NOP:
+                break;
+            case INSTR_EXIT:
+                ++steps;
+                stop = SIM_STOP_EXIT;
+                goto stopped;
+            case OPCODE_END:
+                stop = SIM_STOP_END;
+                goto stopped;
+            case OPCODE_INVALID:
+            default:
+                error_ = "invalid instruction " + hexString(static_cast<uint32_t>(instruction.immediate));
+                goto stopped;
+        }
+        regs[0] = 0;
+    }
+
+stopped:
+    --index;  // the program counter stays at the instruction that stopped
+finished:
+    regs[0] = 0;
+    pc_ = static_cast<uint32_t>(index * 4);
+    steps_ = steps;
+    return stop;
+}
+
+// --------------------------------------------------------
+
+void Simulator::writeState(std::ostream &out, int stop) const {
+    OutputBuffer buffer(out);
+    switch (stop) {
+        case SIM_STOP_EXIT:
+            buffer << "exit";
+            break;
+        case SIM_STOP_END:
+            buffer << "end of program";
+            break;
+        case SIM_STOP_LIMIT:
+            buffer << "instruction limit reached";
+            break;
+        default:
+            buffer << "error: " << error_;
+            break;
+    }
+    buffer << " after " << steps_ << " instructions, pc 0x";
+    buffer.appendHex(pc_);
+    buffer << "\n\nRegisters\n";
+    for (size_t i = 0; i < 32; ++i) {
+        buffer.appendPadded(REGISTER_ABRV[i].name, 6);
+        buffer << "0x";
+        buffer.appendHex(registers_[i]);
+        buffer << (i % 4 == 3 ? "\n" : "    ");
+    }
+    buffer.appendPadded("$hi", 6);
+    buffer << "0x";
+    buffer.appendHex(hi_);
+    buffer << "    ";
+    buffer.appendPadded("$lo", 6);
+    buffer << "0x";
+    buffer.appendHex(lo_);
+    buffer << "\n";
+
+    buffer << "\nMemory\n";
+    for (size_t i = 0; i < memory_.size(); ++i) {
+        if (memory_[i] == 0) continue;
+        buffer << "0x";
+        buffer.appendHex(static_cast<uint32_t>(i * 4));
+        buffer << "    0x";
+        buffer.appendHex(memory_[i]);
+        buffer << "\n";
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef MIPS_SIMULATOR_H
+#define MIPS_SIMULATOR_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "instruction.hpp"
+
+// reasons why a simulation stopped
+enum {
+    SIM_STOP_EXIT,   // executed "exit"
+    SIM_STOP_END,    // ran past the last instruction
+    SIM_STOP_LIMIT,  // executed the maximum number of instructions
+    SIM_STOP_ERROR   // invalid instruction, jump or memory access
+};
+
+/**
+ * @brief Executes an image of encoded instructions. The image is decoded once
+ * into an array of Instruction records, the loop then dispatches on the
+ * opcode of the record at the program counter. Instructions and data live in
+ * separate memories, both start at address 0. There are no delay slots, so
+ * jal and the other linking instructions link to the next instruction, and
+ * add, sub and addi wrap around instead of trapping on overflow.
+ */
+class Simulator {
+   public:
+    /**
+     * @param image encoded instructions, the first one is at address 0
+     * @param data initial contents of the data memory from address 0, see
+     * dataWord
+     * @param memorySize size of the data memory in bytes, enlarged to hold
+     * the data
+     */
+    Simulator(const std::vector<uint32_t> &image, const std::vector<uint8_t> &data, size_t memorySize);
+
+    /**
+     * @brief Runs from the current program counter until the program stops.
+     *
+     * @param maxSteps maximum number of instructions to execute, 0 for no
+     * limit
+     * @return int SIM_STOP_*
+     */
+    int run(uint64_t maxSteps);
+
+    uint32_t pc() const { return pc_; }
+    uint64_t steps() const { return steps_; }
+    const uint32_t *registers() const { return registers_; }
+    uint32_t hi() const { return hi_; }
+    uint32_t lo() const { return lo_; }
+    const std::vector<uint32_t> &memory() const { return memory_; }
+
+    /**
+     * @brief Description of the error, if run returned SIM_STOP_ERROR.
+     */
+    const std::string &error() const { return error_; }
+
+    /**
+     * @brief Writes the reason of the stop, all registers and the data memory
+     * words that are not 0.
+     */
+    void writeState(std::ostream &out, int stop) const;
+
+   private:
+    std::vector<Instruction> program_;  // decoded image and an end marker
+    std::vector<uint32_t> memory_;
+    uint32_t registers_[32] = {};
+    uint32_t hi_ = 0;  // results of mult and div
+    uint32_t lo_ = 0;
+    uint32_t pc_ = 0;
+    uint64_t steps_ = 0;
+    std::string error_;
+};
+
+#endif
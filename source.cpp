@@ -0,0 +1,107 @@
+#include "source.hpp"
+
+#include <fstream>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MIPS_HAVE_MMAP 1
+#endif
+
+namespace {
+
+/**
+ * @brief Appends the rest of a stream to buffer in large chunks.
+ *
+ * @return true, if the stream was read without a read error
+ */
+bool readStream(std::istream &in, std::string &buffer) {
+    char chunk[1 << 16];
+    while (in.read(chunk, sizeof(chunk)) || in.gcount() > 0) {
+        buffer.append(chunk, static_cast<size_t>(in.gcount()));
+    }
+    return !in.bad();
+}
+
+}  // namespace
+
+// --------------------------------------------------------
+
+SourceFile::~SourceFile() { close(); }
+
+// --------------------------------------------------------
+
+bool SourceFile::open(const std::string &path) {
+    close();
+
+    if (path == "-") {
+        bool ok = readStream(std::cin, buffer_);
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+        return ok;
+    }
+
+#ifdef MIPS_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode)) {
+        size_ = static_cast<size_t>(file_stat.st_size);
+        if (size_ == 0) {  // empty files can't be mapped
+            ::close(fd);
+            return true;
+        }
+
+        void *addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            madvise(addr, size_, MADV_SEQUENTIAL);
+            ::close(fd);
+            data_ = static_cast<const char *>(addr);
+            mapped_ = true;
+            return true;
+        }
+        size_ = 0;
+    }
+    ::close(fd);
+#endif
+
+    // fall back to reading the file (pipes, devices, no mmap)
+    std::ifstream fileReader(path, std::ios::binary);
+    if (!fileReader.is_open()) return false;
+    bool ok = readStream(fileReader, buffer_);
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+    return ok;
+}
+
+// --------------------------------------------------------
+
+void SourceFile::close() {
+#ifdef MIPS_HAVE_MMAP
+    if (mapped_) munmap(const_cast<char *>(data_), size_);
+#endif
+    mapped_ = false;
+    data_ = nullptr;
+    size_ = 0;
+    buffer_.clear();
+}
+
+// --------------------------------------------------------
+
+bool nextLine(std::string_view text, size_t &pos, std::string_view &line) {
+    if (pos >= text.size()) return false;
+
+    size_t end = text.find('\n', pos);
+    if (end == std::string_view::npos) {
+        line = text.substr(pos);
+        pos = text.size();
+    } else {
+        line = text.substr(pos, end - pos);
+        pos = end + 1;
+    }
+    return true;
+}
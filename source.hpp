@@ -0,0 +1,55 @@
+#ifndef MIPS_SOURCE_H
+#define MIPS_SOURCE_H
+
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Read-only view of a whole source file. Regular files are mapped into
+ * memory, standard input ("-") is read into a single growing buffer, so both
+ * passes can work on slices of the same buffer without copying lines.
+ */
+class SourceFile {
+   public:
+    SourceFile() = default;
+    SourceFile(const SourceFile &) = delete;
+    SourceFile &operator=(const SourceFile &) = delete;
+    ~SourceFile();
+
+    /**
+     * @brief Opens and maps the given file. A previously opened file is
+     * released first.
+     *
+     * @param path path to the file or "-" for standard input
+     * @return true, if the whole file is available via text()
+     */
+    bool open(const std::string &path);
+
+    /**
+     * @brief Releases the mapping or buffer. Views returned by text() become
+     * invalid.
+     */
+    void close();
+
+    std::string_view text() const { return {data_, size_}; }
+
+   private:
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::string buffer_;  // used if the input can't be mapped
+};
+
+/**
+ * @brief Gets the next line of text like std::getline does, but without
+ * copying it.
+ *
+ * @param text whole text
+ * @param pos offset of the next line in text, will be moved behind the line
+ * break
+ * @param line receives the line without the line break
+ * @return true, if a line was read
+ */
+bool nextLine(std::string_view text, size_t &pos, std::string_view &line);
+
+#endif
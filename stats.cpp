@@ -0,0 +1,123 @@
+#include "stats.hpp"
+
+#include <cstdio>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#define MIPS_HAVE_RUSAGE 1
+#endif
+
+namespace {
+
+// names of the phases in the reports, in the order of STATS_*
+const char *const PHASE_NAMES[STATS_PHASE_COUNT] = {"read", "firstPass", "secondPass", "lexing",
+                                                     "listing", "encoding", "image", "total"};
+
+/**
+ * @brief Time of the passes that is neither lexing nor listing.
+ */
+double parsingSeconds(const AssemblerStats &stats) {
+    double seconds = stats.seconds[STATS_FIRST_PASS] + stats.seconds[STATS_SECOND_PASS] -
+                     stats.seconds[STATS_LEXING] - stats.seconds[STATS_LISTING];
+    return seconds < 0 ? 0 : seconds;
+}
+
+}  // namespace
+
+std::atomic<uint64_t> heapAllocations{0};
+bool heapAllocationsCounted = false;
+
+// --------------------------------------------------------
+
+void AssemblerStats::add(const AssemblerStats &other) {
+    for (int i = 0; i < STATS_PHASE_COUNT; ++i) seconds[i] += other.seconds[i];
+    files += other.files;
+    bytes += other.bytes;
+    lines += other.lines;
+    instructions += other.instructions;
+    labels += other.labels;
+    comments += other.comments;
+    labelResolutions += other.labelResolutions;
+    cachedLines += other.cachedLines;
+    allocations += other.allocations;
+}
+
+// --------------------------------------------------------
+
+uint64_t peakMemory() {
+#ifdef MIPS_HAVE_RUSAGE
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss);  // bytes
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;  // KiB
+#endif
+#else
+    return 0;
+#endif
+}
+
+// --------------------------------------------------------
+
+void writeStatsText(std::ostream &out, const AssemblerStats &stats) {
+    char row[96];
+    auto counter = [&](const char *name, uint64_t value) {
+        std::snprintf(row, sizeof(row), "  %-20s %14llu\n", name, static_cast<unsigned long long>(value));
+        out << row;
+    };
+    auto phase = [&](const char *name, double seconds) {
+        std::snprintf(row, sizeof(row), "  %-20s %11.3f ms\n", name, seconds * 1e3);
+        out << row;
+    };
+
+    out << "Stats\n";
+    counter("files", stats.files);
+    counter("bytes", stats.bytes);
+    counter("lines", stats.lines);
+    counter("instructions", stats.instructions);
+    counter("labels", stats.labels);
+    counter("comments", stats.comments);
+    counter("label resolutions", stats.labelResolutions);
+    counter("cached lines", stats.cachedLines);
+    if (heapAllocationsCounted) {
+        counter("heap allocations", stats.allocations);
+    } else {
+        std::snprintf(row, sizeof(row), "  %-20s %14s\n", "heap allocations", "n/a");
+        out << row;
+    }
+    counter("peak memory bytes", peakMemory());
+
+    phase("read", stats.seconds[STATS_READ]);
+    phase("first pass", stats.seconds[STATS_FIRST_PASS]);
+    phase("second pass", stats.seconds[STATS_SECOND_PASS]);
+    phase("lexing", stats.seconds[STATS_LEXING]);
+    phase("parsing", parsingSeconds(stats));
+    phase("listing", stats.seconds[STATS_LISTING]);
+    phase("encoding", stats.seconds[STATS_ENCODING]);
+    phase("image", stats.seconds[STATS_IMAGE]);
+    phase("total", stats.seconds[STATS_TOTAL]);
+}
+
+// --------------------------------------------------------
+
+void writeStatsJson(std::ostream &out, const AssemblerStats &stats) {
+    out << "{\"files\": " << stats.files << ", \"bytes\": " << stats.bytes << ", \"lines\": " << stats.lines
+        << ", \"instructions\": " << stats.instructions << ", \"labels\": " << stats.labels
+        << ", \"comments\": " << stats.comments << ", \"labelResolutions\": " << stats.labelResolutions
+        << ", \"cachedLines\": " << stats.cachedLines << ", \"allocations\": ";
+    if (heapAllocationsCounted) {
+        out << stats.allocations;
+    } else {
+        out << "null";
+    }
+    out << ", \"peakMemory\": " << peakMemory()
+        << ", \"seconds\": {";
+    char number[32];
+    for (int i = 0; i < STATS_PHASE_COUNT; ++i) {
+        std::snprintf(number, sizeof(number), "%.6f", stats.seconds[i]);
+        out << (i == 0 ? "\"" : ", \"") << PHASE_NAMES[i] << "\": " << number;
+    }
+    std::snprintf(number, sizeof(number), "%.6f", parsingSeconds(stats));
+    out << ", \"parsing\": " << number << "}}\n";
+}
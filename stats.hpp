@@ -0,0 +1,107 @@
+#ifndef MIPS_STATS_H
+#define MIPS_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// phases of assembling that are timed, see AssemblerStats
+enum {
+    STATS_READ,         // opening and mapping the source
+    STATS_FIRST_PASS,   // collecting the labels, including lexing
+    STATS_SECOND_PASS,  // parsing the instructions, including lexing and listing
+    STATS_LEXING,       // lexLine in both passes
+    STATS_LISTING,      // formatting the listing and the symbol table, in the passes
+    STATS_ENCODING,     // encoding the instruction records into words
+    STATS_IMAGE,        // formatting and writing the instructions file
+    STATS_TOTAL,        // everything of a file, including the phases above
+    STATS_PHASE_COUNT
+};
+
+/**
+ * @brief Times and counters of assembling one or more files. Every pass
+ * takes an optional pointer to it and leaves it alone if it is nullptr. The
+ * times of passes that run on several threads are summed over the threads.
+ */
+struct AssemblerStats {
+    double seconds[STATS_PHASE_COUNT] = {};
+    uint64_t files = 0;
+    uint64_t bytes = 0;             // size of the sources
+    uint64_t lines = 0;
+    uint64_t instructions = 0;
+    uint64_t labels = 0;            // distinct labels
+    uint64_t comments = 0;          // lines with a comment
+    uint64_t labelResolutions = 0;  // instructions that refer to a label
+    uint64_t cachedLines = 0;       // lines taken from the cache of --incremental
+    uint64_t allocations = 0;       // heap allocations, see heapAllocations
+
+    /**
+     * @brief Adds the times and counters of another file or part of a file.
+     */
+    void add(const AssemblerStats &other);
+};
+
+/**
+ * @brief Adds the time from its construction to stop() or its destruction
+ * to a phase of the stats. Does nothing if the stats are nullptr.
+ */
+class StatsTimer {
+   public:
+    StatsTimer(AssemblerStats *stats, int phase)
+        : stats_(stats)
+        , phase_(phase) {
+        if (stats_) start_ = std::chrono::steady_clock::now();
+    }
+    StatsTimer(const StatsTimer &) = delete;
+    StatsTimer &operator=(const StatsTimer &) = delete;
+    ~StatsTimer() { stop(); }
+
+    void stop() {
+        if (!stats_) return;
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_;
+        stats_->seconds[phase_] += elapsed.count();
+        stats_ = nullptr;
+    }
+
+   private:
+    AssemblerStats *stats_;
+    int phase_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * @brief Number of heap allocations of the process so far. It is only counted
+ * by programs that are linked with allocations.cpp, otherwise it stays 0. As
+ * it counts the whole process, the allocations of files that are assembled
+ * concurrently are mixed up.
+ */
+extern std::atomic<uint64_t> heapAllocations;
+
+/**
+ * @brief Tells whether heapAllocations is counted, that is whether the program
+ * is linked with allocations.cpp. The reports leave the allocations out
+ * otherwise.
+ */
+extern bool heapAllocationsCounted;
+
+/**
+ * @return uint64_t largest resident set size of the process so far in bytes,
+ * 0 if the platform doesn't tell
+ */
+uint64_t peakMemory();
+
+/**
+ * @brief Writes the stats as a table for humans, with "n/a" for the heap
+ * allocations if they aren't counted.
+ */
+void writeStatsText(std::ostream &out, const AssemblerStats &stats);
+
+/**
+ * @brief Writes the stats as a single JSON object with the members files,
+ * bytes, the counters, peakMemory and seconds, an object with one member per
+ * phase. allocations is null if they aren't counted.
+ */
+void writeStatsJson(std::ostream &out, const AssemblerStats &stats);
+
+#endif
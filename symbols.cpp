@@ -0,0 +1,94 @@
+#include "symbols.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// 64 bit FNV-1a
+uint64_t hashName(std::string_view name) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (char c: name) hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001B3ull;
+    return hash;
+}
+
+}  // namespace
+
+// --------------------------------------------------------
+
+std::string_view Arena::copy(std::string_view s) {
+    while (chunk_ < chunks_.size() && used_ + s.size() > chunks_[chunk_].size) {
+        ++chunk_;
+        used_ = 0;
+    }
+    if (chunk_ == chunks_.size()) {
+        size_t size = std::max(chunkSize_, s.size());
+        chunks_.push_back({std::make_unique<char[]>(size), size});
+    }
+
+    char *dest = chunks_[chunk_].data.get() + used_;
+    if (!s.empty()) std::memcpy(dest, s.data(), s.size());
+    used_ += s.size();
+    return std::string_view(dest, s.size());
+}
+
+// --------------------------------------------------------
+
+void SymbolTable::set(std::string_view name, int address, int segment) {
+    if (2 * (symbols_.size() + 1) > slots_.size()) grow();
+
+    uint64_t hash = hashName(name);
+    size_t i = slot(hash);
+    for (; slots_[i] != 0; i = (i + 1) & (slots_.size() - 1)) {
+        Symbol &symbol = symbols_[slots_[i] - 1];
+        if (symbol.hash == hash && symbol.name == name) {
+            if (symbol.address != address || symbol.segment != segment) ++redefinitions_;
+            symbol.address = address;
+            symbol.segment = segment;
+            return;
+        }
+    }
+    symbols_.push_back({names_.copy(name), address, hash, segment});
+    slots_[i] = static_cast<uint32_t>(symbols_.size());
+}
+
+// --------------------------------------------------------
+
+const SymbolTable::Symbol *SymbolTable::findSymbol(std::string_view name) const {
+    if (slots_.empty()) return nullptr;
+    uint64_t hash = hashName(name);
+    for (size_t i = slot(hash); slots_[i] != 0; i = (i + 1) & (slots_.size() - 1)) {
+        const Symbol &symbol = symbols_[slots_[i] - 1];
+        if (symbol.hash == hash && symbol.name == name) return &symbol;
+    }
+    return nullptr;
+}
+
+// --------------------------------------------------------
+
+void SymbolTable::clear() {
+    symbols_.clear();
+    std::fill(slots_.begin(), slots_.end(), 0);
+    names_.clear();
+    redefinitions_ = 0;
+}
+
+// --------------------------------------------------------
+
+std::vector<SymbolTable::Symbol> SymbolTable::sorted() const {
+    std::vector<Symbol> symbols = symbols_;
+    std::sort(symbols.begin(), symbols.end(), [](const Symbol &a, const Symbol &b) { return a.name < b.name; });
+    return symbols;
+}
+
+// --------------------------------------------------------
+
+void SymbolTable::grow() {
+    // at most half of the slots are used
+    slots_.assign(std::max<size_t>(64, 2 * slots_.size()), 0);
+    for (size_t index = 0; index < symbols_.size(); ++index) {
+        size_t i = slot(symbols_[index].hash);
+        while (slots_[i] != 0) i = (i + 1) & (slots_.size() - 1);
+        slots_[i] = static_cast<uint32_t>(index + 1);
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef MIPS_SYMBOLS_H
+#define MIPS_SYMBOLS_H
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Bump allocator for strings that live as long as a whole run. Copies
+ * are appended to large chunks and are all freed at once by clear(), which
+ * keeps the chunks for the next run.
+ */
+class Arena {
+   public:
+    explicit Arena(size_t chunkSize = 64 * 1024)
+        : chunkSize_(chunkSize) {}
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    Arena(Arena &&) = default;
+    Arena &operator=(Arena &&) = default;
+
+    /**
+     * @brief Copies a string into the arena.
+     *
+     * @return std::string_view the copy, valid until clear() is called
+     */
+    std::string_view copy(std::string_view s);
+
+    /**
+     * @brief Frees all copies at once, the memory is kept.
+     */
+    void clear() {
+        chunk_ = 0;
+        used_ = 0;
+    }
+
+   private:
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    size_t chunkSize_;
+    std::vector<Chunk> chunks_;
+    size_t chunk_ = 0;  // index of the chunk that is filled
+    size_t used_ = 0;   // bytes used in that chunk
+};
+
+// segments a label can be defined in, see SymbolTable
+enum {
+    SEGMENT_TEXT,  // address in the instructions
+    SEGMENT_DATA   // address in the data memory, see directives.hpp
+};
+
+/**
+ * @brief Addresses of the labels. The names are interned in an arena and the
+ * table uses open addressing over a flat array of indices, so defining or
+ * looking up a label doesn't allocate per label. Defining a label again
+ * replaces its address.
+ */
+class SymbolTable {
+   public:
+    struct Symbol {
+        std::string_view name;
+        int address;
+        uint64_t hash;
+        int segment;  // SEGMENT_*
+    };
+
+    /**
+     * @brief Defines a label or replaces its address and segment.
+     */
+    void set(std::string_view name, int address, int segment = SEGMENT_TEXT);
+
+    /**
+     * @return const int* address of the label, nullptr if it is not defined
+     */
+    const int *find(std::string_view name) const {
+        const Symbol *symbol = findSymbol(name);
+        return symbol ? &symbol->address : nullptr;
+    }
+
+    /**
+     * @return const Symbol* the label with its segment, nullptr if it is not
+     * defined
+     */
+    const Symbol *findSymbol(std::string_view name) const;
+
+    size_t size() const { return symbols_.size(); }
+    bool empty() const { return symbols_.empty(); }
+
+    /**
+     * @return size_t number of times set moved a label that was defined
+     * already
+     */
+    size_t redefinitions() const { return redefinitions_; }
+
+    /**
+     * @brief Removes all labels, the memory is kept for the next run.
+     */
+    void clear();
+
+    // in the order of the first definition
+    std::vector<Symbol>::const_iterator begin() const { return symbols_.begin(); }
+    std::vector<Symbol>::const_iterator end() const { return symbols_.end(); }
+
+    /**
+     * @return std::vector<Symbol> the labels sorted by name
+     */
+    std::vector<Symbol> sorted() const;
+
+   private:
+    size_t slot(uint64_t hash) const { return (hash ^ (hash >> 29)) & (slots_.size() - 1); }
+    void grow();
+
+    std::vector<Symbol> symbols_;
+    std::vector<uint32_t> slots_;  // index into symbols_ + 1, 0 for empty, size is a power of 2
+    Arena names_;
+    size_t redefinitions_ = 0;
+};
+
+#endif
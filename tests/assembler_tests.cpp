@@ -0,0 +1,626 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "assembler.hpp"
+#include "cache.hpp"
+#include "object.hpp"
+#include "simulator.hpp"
+#include "source.hpp"
+
+namespace {
+
+// failed checks of the test that runs, see CHECK
+int failures = 0;
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+void check(bool ok, const char *expression, int line) {
+    if (ok) return;
+    std::cerr << __FILE__ << ":" << line << ": check failed: " << expression << "\n";
+    ++failures;
+}
+
+/**
+ * @brief Everything an assembler run leaves behind, in a form that can be
+ * compared.
+ */
+struct RunResult {
+    bool success = false;
+    std::vector<uint32_t> words;
+    std::vector<uint8_t> data;
+    std::string listing;
+    std::string symbols;      // "name address segment" per label, sorted by name
+    std::string diagnostics;  // as written by writeText
+
+    bool operator==(const RunResult &other) const {
+        return success == other.success && words == other.words && data == other.data && listing == other.listing &&
+               symbols == other.symbols && diagnostics == other.diagnostics;
+    }
+};
+
+RunResult assembleSource(std::string_view source, const AssemblerOptions &options, LineCache *cache = nullptr) {
+    Assembler assembler(options);
+    RunResult result;
+    result.success = assembler.assemble(source, "test.s", cache);
+    result.words = assembler.words();
+    result.data = assembler.data();
+    result.listing = assembler.listing();
+    std::ostringstream symbols, diagnostics;
+    for (const auto &symbol: assembler.symbols().sorted()) {
+        symbols << symbol.name << " " << symbol.address << " " << symbol.segment << "\n";
+    }
+    assembler.diagnostics().writeText(diagnostics);
+    result.symbols = symbols.str();
+    result.diagnostics = diagnostics.str();
+    return result;
+}
+
+std::string readFile(const std::string &path) {
+    SourceFile file;
+    if (!file.open(path)) {
+        std::cerr << "can't read " << path << "\n";
+        ++failures;
+        return "";
+    }
+    return std::string(file.text());
+}
+
+// pseudo-instructions, macros, the data segment, forward and backward
+// references and a label that is defined twice
+const char *const FEATURE_SOURCE = R"(.macro inc r
+    addi \r, \r, 1
+.endm
+.data
+table: .word 1, 2, 3
+bytes: .byte 4, 5
+.align 2
+last: .word 6
+.text
+main: li $t0, 70000
+    la $t1, table
+    lw $t2, table
+    lw $t3, last($zero)
+    sw $t2, bytes($t0)
+    inc $t0
+loop: addi $t0, $t0, -1
+    bnez $t0, loop
+    beq $t0, $zero, done
+    blt $t0, $t1, main
+    j done
+    nop
+done: jal main
+dup: nop
+    b dup
+dup: nop
+    j dup
+    exit
+)";
+
+// errors in lines that are encoded at once and in lines that wait for a label
+const char *const ERROR_SOURCE = R"(.data
+v: .word 1
+.text
+    add $t1, $t2, $t9x
+    lw $t1, 4(
+    addi $t0, $t0, 70000
+    j v
+    j later
+later: nop
+    beq $t0, $t0, v
+)";
+
+// --------------------------------------------------------
+
+/**
+ * @brief The one-pass mode gives the same results as the two passes.
+ */
+void testOnePass() {
+    std::vector<std::string> sources = {FEATURE_SOURCE};
+    for (int i = 1; i <= 4; ++i) {
+        sources.push_back(readFile(std::string(MIPS_SOURCE_DIR) + "/files/program" + std::to_string(i) + ".txt"));
+    }
+    for (const std::string &source: sources) {
+        AssemblerOptions options;
+        options.listing = true;
+        RunResult two_pass = assembleSource(source, options);
+        options.onePass = true;
+        RunResult one_pass = assembleSource(source, options);
+        CHECK(two_pass.success);
+        CHECK(one_pass == two_pass);
+    }
+
+    // the last definition of a label counts in both modes
+    AssemblerOptions options;
+    RunResult two_pass = assembleSource(FEATURE_SOURCE, options);
+    options.onePass = true;
+    RunResult one_pass = assembleSource(FEATURE_SOURCE, options);
+    CHECK(one_pass.words == two_pass.words);
+    CHECK(two_pass.symbols.find("dup 100 0\n") != std::string::npos);
+
+    // one-pass mode reports the errors of forward references after the pass,
+    // so only the errors themselves are compared
+    options.onePass = false;
+    two_pass = assembleSource(ERROR_SOURCE, options);
+    options.onePass = true;
+    one_pass = assembleSource(ERROR_SOURCE, options);
+    CHECK(!two_pass.success && !one_pass.success);
+    CHECK(one_pass.words == two_pass.words);
+    CHECK(one_pass.diagnostics.size() == two_pass.diagnostics.size());
+    CHECK(two_pass.diagnostics.find("test.s:7:7: error: label 'v' is in the data segment!") != std::string::npos);
+    CHECK(two_pass.diagnostics.find("test.s:10:19: error: label 'v' is in the data segment!") != std::string::npos);
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Generates a source that is large enough to be split into chunks.
+ * Branches reach a few labels back and forth, so they cross the chunks,
+ * jumps anywhere.
+ *
+ * @param error_every every so many blocks get an error, 0 for none
+ */
+std::string largeSource(int blocks, int error_every) {
+    std::ostringstream out;
+    for (int i = 0; i < blocks; ++i) {
+        out << "L" << i << ": addi $t0, $t0, " << i % 1000 << "    # block " << i << "\n"
+            << "    lw $t1, " << 4 * (i % 64) << "($sp)\n"
+            << "    li $t2, " << i * 4099 << "\n"
+            << "    beq $t0, $t1, L" << std::min(i + 7, blocks - 1) << "\n"
+            << "    blt $t1, $t2, L" << std::max(i - 5, 0) << "\n"
+            << "# a comment line between the blocks\n"
+            << "    j L" << (i * 31) % blocks << "\n";
+        if (error_every != 0 && i % error_every == error_every - 1) out << "    add $t1, $t2\n";
+    }
+    out << "exit\n";
+    return out.str();
+}
+
+/**
+ * @brief Assembling in parallel chunks gives the same results as one chunk,
+ * also when the error limit is reached in a later chunk.
+ */
+void testParallel() {
+    std::string source = largeSource(20000, 0);
+    CHECK(source.size() > 4 * 256 * 1024);  // at least four chunks
+    for (bool listing: {false, true}) {
+        AssemblerOptions options;
+        options.listing = listing;
+        RunResult serial = assembleSource(source, options);
+        options.jobs = 4;
+        RunResult parallel = assembleSource(source, options);
+        CHECK(serial.success);
+        CHECK(parallel == serial);
+    }
+
+    std::string errors = largeSource(20000, 1500);
+    for (size_t max_errors: {0, 3, 7}) {
+        AssemblerOptions options;
+        options.listing = true;
+        options.maxErrors = max_errors;
+        RunResult serial = assembleSource(errors, options);
+        options.jobs = 4;
+        RunResult parallel = assembleSource(errors, options);
+        CHECK(!serial.success);
+        CHECK(parallel == serial);
+    }
+}
+
+// --------------------------------------------------------
+
+// offsets in a cache file, see LineCache::save: magic, number of entries and
+// size of the names in front of the entries
+constexpr size_t CACHE_HEADER_SIZE = 8 + 8 + 8;
+
+/**
+ * @brief Changes bytes of the first entry of a cache file.
+ */
+void damageCache(const std::string &path, const std::string &damaged, size_t offset, const void *bytes, size_t size) {
+    std::string file = readFile(path);
+    std::memcpy(&file[CACHE_HEADER_SIZE + offset], bytes, size);
+    std::ofstream(damaged, std::ios::binary) << file;
+}
+
+/**
+ * @brief A cache that is saved and loaded again gives the same results as
+ * assembling without a cache, and a damaged cache file is ignored.
+ */
+void testCache() {
+    std::string first = "start: addi $t0, $zero, 5\n"
+                        "loop: addi $t0, $t0, -1\n"
+                        "    bne $t0, $zero, loop\n"
+                        "    j end\n"
+                        "    sw $t0, 8($sp)   # store\n"
+                        "end: exit\n";
+    // a line in front moves all labels, the loop branches further
+    std::string second = "    nop\n"
+                         "start: addi $t0, $zero, 5\n"
+                         "loop: addi $t0, $t0, -1\n"
+                         "    add $t1, $t0, $t0\n"
+                         "    bne $t0, $zero, loop\n"
+                         "    j end\n"
+                         "    sw $t0, 8($sp)   # store\n"
+                         "    jal start\n"
+                         "end: exit\n";
+    const std::string path = "cache-test.cache";
+
+    AssemblerOptions options;
+    LineCache cache;
+    RunResult cold = assembleSource(first, options, &cache);
+    CHECK(cold == assembleSource(first, options));
+    CHECK(cache.save(path));
+
+    LineCache loaded;
+    CHECK(loaded.load(path));
+    RunResult warm = assembleSource(second, options, &loaded);
+    CHECK(warm.success);
+    CHECK(warm == assembleSource(second, options));
+    CHECK(assembleSource(first, options, &loaded) == cold);
+
+    // a label name outside of the names and an opcode outside of INSTR_CODES
+    uint32_t label = 0xFFFFFF00;
+    damageCache(path, "cache-test-label.cache", offsetof(CacheEntry, label), &label, sizeof(label));
+    uint8_t opcode = 0xF0;
+    damageCache(path, "cache-test-opcode.cache", offsetof(CacheEntry, instruction) + offsetof(Instruction, opcode),
+                &opcode, sizeof(opcode));
+    for (const char *damaged: {"cache-test-label.cache", "cache-test-opcode.cache"}) {
+        LineCache broken;
+        CHECK(!broken.load(damaged));
+        CHECK(assembleSource(first, options, &broken) == cold);
+    }
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Assembles a source into an object, which is saved and loaded again.
+ */
+ObjectFile assembleObject(std::string_view source, const std::string &name) {
+    AssemblerOptions options;
+    options.object = true;
+    Assembler assembler(options);
+    CHECK(assembler.assemble(source, name));
+    CHECK(assembler.object().save(name + ".o"));
+    ObjectFile object;
+    CHECK(object.load(name + ".o"));
+    return object;
+}
+
+bool link(const std::vector<ObjectFile> &objects,
+          std::vector<uint32_t> &words,
+          std::vector<uint8_t> &data,
+          std::string &diagnostics) {
+    std::vector<Diagnostics> object_diagnostics;
+    for (const ObjectFile &object: objects) object_diagnostics.emplace_back(std::string(object.source()));
+    bool success = linkObjects(objects, words, data, object_diagnostics, 2);
+    std::ostringstream out;
+    for (const Diagnostics &d: object_diagnostics) d.writeText(out);
+    diagnostics = out.str();
+    return success;
+}
+
+/**
+ * @brief Linked objects give the same program as their sources assembled as
+ * one, and labels that are missing, defined twice or of the wrong segment
+ * are errors.
+ */
+void testLinker() {
+    // the data of the first object fills 16 bytes, so the data of the second
+    // one is at the same address in both layouts
+    std::string main_source = ".data\n"
+                              "count: .word 3, 0, 0, 0\n"
+                              ".text\n"
+                              "main: lw $t0, count\n"
+                              "    la $t1, values\n"
+                              "    jal sum\n"
+                              "    beq $t0, $zero, main\n"
+                              "    exit\n";
+    std::string sum_source = ".data\n"
+                             "values: .word 1, 2, 3\n"
+                             ".text\n"
+                             "sum: lw $t2, 0($t1)\n"
+                             "    lw $t3, values\n"
+                             "    bne $t2, $t3, sum\n"
+                             "    jr $ra\n";
+
+    std::vector<uint32_t> words;
+    std::vector<uint8_t> data;
+    std::string diagnostics;
+    std::vector<ObjectFile> objects = {assembleObject(main_source, "link-main"), assembleObject(sum_source, "link-sum")};
+    CHECK(link(objects, words, data, diagnostics));
+    CHECK(diagnostics.empty());
+    RunResult whole = assembleSource(main_source + sum_source, AssemblerOptions());
+    CHECK(whole.success);
+    CHECK(words == whole.words);
+    CHECK(data == whole.data);
+
+    // a label that no object defines
+    objects = {assembleObject(main_source, "link-main")};
+    CHECK(!link(objects, words, data, diagnostics));
+    CHECK(diagnostics.find("sum") != std::string::npos);
+
+    // a label that two objects define
+    objects = {assembleObject(main_source, "link-main"), assembleObject(sum_source, "link-sum"),
+               assembleObject("sum: nop\n", "link-twice")};
+    CHECK(!link(objects, words, data, diagnostics));
+    CHECK(diagnostics.find("sum") != std::string::npos);
+
+    // a jump to a label of the data segment of another object
+    objects = {assembleObject("j values\n", "link-jump"), assembleObject(sum_source, "link-sum")};
+    CHECK(!link(objects, words, data, diagnostics));
+    CHECK(diagnostics.find("label 'values' is in the data segment!") != std::string::npos);
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief Relative paths of ".incbin" are resolved against the directory of
+ * the source, not the working directory, in all modes.
+ */
+void testIncbin() {
+    const std::string directory = std::string(MIPS_SOURCE_DIR) + "/files";
+    std::string file = readFile(directory + "/program1.txt");
+    std::vector<uint8_t> expected(file.begin(), file.end());
+    expected.resize((expected.size() + 3) / 4 * 4);  // the next label is word aligned
+
+    const std::string source = ".data\n"
+                               "blob: .incbin \"program1.txt\"\n"
+                               "after: .word 7\n"
+                               ".text\n"
+                               "main: la $t0, after\n";
+    for (int mode = 0; mode < 3; ++mode) {
+        AssemblerOptions options;
+        options.onePass = mode == 1;
+        options.object = mode == 2;
+        Assembler assembler(options);
+        CHECK(assembler.assemble(source, directory + "/incbin.s"));
+        const std::vector<uint8_t> &data = mode == 2 ? assembler.object().data : assembler.data();
+        CHECK(data.size() == expected.size() + 4);
+        CHECK(std::equal(expected.begin(), expected.end(), data.begin()));
+    }
+
+    // the working directory of the tests has no program1.txt, an absolute
+    // path is taken as it is
+    Assembler assembler;
+    CHECK(!assembler.assemble(source, "incbin.s"));
+    CHECK(assembler.assemble(".data\n.incbin \"" + directory + "/program1.txt\"\n", "other/incbin.s"));
+    CHECK(assembler.data().size() == file.size());
+}
+
+// --------------------------------------------------------
+
+/**
+ * @brief The listings and instructions of the lexer still match the ones of
+ * the regex lexer it replaced, stored in tests/data from that version.
+ */
+void testListing() {
+    const std::string data = std::string(MIPS_SOURCE_DIR) + "/tests/data/";
+    std::vector<std::pair<std::string, std::string>> sources = {{data + "lexer.s", data + "lexer"}};
+    for (int i = 1; i <= 4; ++i) {
+        std::string name = "program" + std::to_string(i);
+        sources.emplace_back(std::string(MIPS_SOURCE_DIR) + "/files/" + name + ".txt", data + name);
+    }
+    for (const auto &[source, expected]: sources) {
+        AssemblerOptions options;
+        options.listing = true;
+        RunResult result = assembleSource(readFile(source), options);
+        CHECK(result.success);
+        CHECK(result.listing == readFile(expected + ".lst"));
+        std::ostringstream hex;
+        writeImage(hex, result.words, IMAGE_FORMAT_HEX);
+        CHECK(hex.str() == readFile(expected + ".hex"));
+    }
+}
+
+// --------------------------------------------------------
+
+std::string image(const std::vector<uint32_t> &words, int format) {
+    std::ostringstream out;
+    writeImage(out, words, format);
+    return out.str();
+}
+
+/**
+ * @brief Every image format writes the words in its byte order and syntax,
+ * the data segment is packed into little endian words.
+ */
+void testImages() {
+    const std::vector<uint32_t> words = {0x20080005, 0x01084820, 0xDEADBEEF};
+    CHECK(image(words, IMAGE_FORMAT_HEX) == "0x20080005\n0x01084820\n0xdeadbeef\n");
+    CHECK(image(words, IMAGE_FORMAT_VMEM) == "20080005\n01084820\ndeadbeef\n");
+    CHECK(image(words, IMAGE_FORMAT_BIN_LE) == std::string("\x05\x00\x08\x20\x20\x48\x08\x01\xEF\xBE\xAD\xDE", 12));
+    CHECK(image(words, IMAGE_FORMAT_BIN_BE) == std::string("\x20\x08\x00\x05\x01\x08\x48\x20\xDE\xAD\xBE\xEF", 12));
+    CHECK(image(words, IMAGE_FORMAT_IHEX) == ":0C0000002008000501084820DEADBEEF1E\n:00000001FF\n");
+    CHECK(image({}, IMAGE_FORMAT_IHEX) == ":00000001FF\n");
+
+    // the words from 64 KiB on need an extended linear address record
+    std::string large = image(std::vector<uint32_t>(0x4001, 0), IMAGE_FORMAT_IHEX);
+    CHECK(large.find(":020000040001F9\n:0400000000000000FC\n:00000001FF\n") != std::string::npos);
+
+    std::ostringstream data;
+    writeImage(data, std::vector<uint8_t>{1, 2, 3, 4, 5}, IMAGE_FORMAT_HEX);
+    CHECK(data.str() == "0x04030201\n0x00000005\n");
+
+    const char *const names[] = {"hex", "bin-le", "bin-be", "ihex", "vmem"};
+    for (int format = IMAGE_FORMAT_HEX; format <= IMAGE_FORMAT_VMEM; ++format) {
+        CHECK(imageFormatFromName(names[format]) == format);
+    }
+    CHECK(imageFormatFromName("bin") == -1);
+}
+
+// --------------------------------------------------------
+
+// an error in most lines, the one of line 4 is only found after the pass
+const char *const ERRORS_SOURCE = "add $t1, $t2\n"
+                                  "nop\n"
+                                  "addi $t0, $t0, 70000\n"
+                                  "j nowhere\n"
+                                  "lw $t1, 4(\n"
+                                  "foo $t1\n";
+
+/**
+ * @brief All errors are reported with line and column up to the error limit,
+ * as text and as JSON.
+ */
+void testDiagnostics() {
+    AssemblerOptions options;
+    RunResult all = assembleSource(ERRORS_SOURCE, options);
+    CHECK(!all.success);
+    CHECK(all.diagnostics == "test.s:1:1: error: Wrong amount of arguments, operation not supported.\n"
+                             "test.s:3:16: error: Argument too long.\n"
+                             "test.s:4:3: error: label 'nowhere' does not exist!\n"
+                             "test.s:5:1: error: Wrong amount of arguments, operation not supported.\n"
+                             "test.s:6:1: error: Instruction foo is not supported.\n");
+
+    for (bool one_pass: {false, true}) {
+        options.onePass = one_pass;
+        options.maxErrors = 2;
+        Assembler assembler(options);
+        CHECK(!assembler.assemble(ERRORS_SOURCE, "test.s"));
+        const Diagnostics &diagnostics = assembler.diagnostics();
+        CHECK(diagnostics.errorCount() == 2);
+        CHECK(diagnostics.limitReached());
+        std::ostringstream text;
+        diagnostics.writeText(text);
+        CHECK(text.str() == "test.s:1:1: error: Wrong amount of arguments, operation not supported.\n"
+                            "test.s:3:16: error: Argument too long.\n"
+                            "test.s: too many errors, stopped after 2\n");
+    }
+
+    // names and messages are escaped, files without diagnostics are skipped
+    std::vector<Diagnostics> files;
+    files.emplace_back("dir\\\"a\".s");
+    files.back().report(2, 5, SEVERITY_ERROR, "tab\there");
+    files.emplace_back("empty.s");
+    files.emplace_back("b.s");
+    files.back().report(0, 0, SEVERITY_WARNING, "note");
+    std::ostringstream json;
+    writeDiagnosticsJson(json, files);
+    CHECK(json.str() == "[\n"
+                        "  {\"file\": \"dir\\\\\\\"a\\\".s\", \"line\": 2, \"column\": 5, \"severity\": \"error\", "
+                        "\"message\": \"tab\\u0009here\"},\n"
+                        "  {\"file\": \"b.s\", \"line\": 0, \"column\": 0, \"severity\": \"warning\", "
+                        "\"message\": \"note\"}\n"
+                        "]\n");
+    CHECK(!files[1].hasErrors() && !files[2].hasErrors());
+    json.str("");
+    writeDiagnosticsJson(json, {files[1]});
+    CHECK(json.str() == "[]\n");
+}
+
+// --------------------------------------------------------
+
+// sums 10 down to 1, uses the data segment, sign extension, a call and mult
+const char *const SIMULATOR_SOURCE = R"(.data
+values: .word 3, -4, 5
+small: .byte 200
+.text
+main: addi $t0, $zero, 0
+    addi $t1, $zero, 10
+loop: add $t0, $t0, $t1
+    addi $t1, $t1, -1
+    bne $t1, $zero, loop
+    la $t2, values
+    lw $t3, 4($t2)
+    add $t3, $t3, $t0
+    sw $t3, 8($t2)
+    lb $t4, small
+    lbu $t5, small
+    jal double
+    lw $t6, 4($t2)
+    mult $t0, $t6
+    exit
+double: add $v0, $t0, $t0
+    jr $ra
+)";
+
+/**
+ * @brief Assembles a program and loads it into a simulator.
+ */
+Simulator loadProgram(std::string_view source, size_t memory_size = 1024) {
+    Assembler assembler;
+    CHECK(assembler.assemble(source, "test.s"));
+    return Simulator(assembler.words(), assembler.data(), memory_size);
+}
+
+/**
+ * @brief The simulator executes the decoded program and stops at exit, at
+ * the end, at the instruction limit and at invalid memory accesses.
+ */
+void testSimulator() {
+    Simulator program = loadProgram(SIMULATOR_SOURCE);
+    CHECK(program.run(0) == SIM_STOP_EXIT);
+    const uint32_t *registers = program.registers();
+    CHECK(registers[8] == 55);           // $t0
+    CHECK(registers[9] == 0);            // $t1
+    CHECK(registers[11] == 51);          // $t3
+    CHECK(registers[12] == 0xFFFFFFC8);  // $t4, lb sign extends
+    CHECK(registers[13] == 200);         // $t5, lbu doesn't
+    CHECK(registers[14] == 0xFFFFFFFC);  // $t6
+    CHECK(registers[2] == 110);          // $v0
+    CHECK(registers[31] == 0x44);        // $ra, no delay slot
+    CHECK(program.hi() == 0xFFFFFFFF && program.lo() == static_cast<uint32_t>(-220));
+    CHECK(program.memory().size() == 256);
+    CHECK(program.memory()[0] == 3 && program.memory()[2] == 51 && program.memory()[3] == 200);
+    CHECK(program.pc() == 0x4C);
+    CHECK(program.steps() == 49);
+
+    Simulator end = loadProgram("nop\nnop\n");
+    CHECK(end.run(0) == SIM_STOP_END);
+    CHECK(end.steps() == 2 && end.pc() == 8);
+
+    Simulator endless = loadProgram("loop: addi $t0, $t0, 1\n    j loop\n");
+    CHECK(endless.run(100) == SIM_STOP_LIMIT);
+    CHECK(endless.steps() == 100 && endless.registers()[8] == 50);
+
+    Simulator invalid = loadProgram("nop\nlw $t0, 1024($zero)\n");
+    CHECK(invalid.run(0) == SIM_STOP_ERROR);
+    CHECK(invalid.pc() == 4 && !invalid.error().empty());
+
+    // the data memory is enlarged to hold the data
+    Simulator large = loadProgram(".data\n.space 2000\nlast: .word 9\n.text\nlw $t0, last\n", 16);
+    CHECK(large.run(0) == SIM_STOP_END);
+    CHECK(large.registers()[8] == 9);
+}
+
+const struct {
+    const char *name;
+    void (*run)();
+} TESTS[] = {
+    {"one-pass", testOnePass},
+    {"parallel", testParallel},
+    {"cache", testCache},
+    {"linker", testLinker},
+    {"incbin", testIncbin},
+    {"listing", testListing},
+    {"images", testImages},
+    {"diagnostics", testDiagnostics},
+    {"simulator", testSimulator},
+};
+
+}  // namespace
+
+// --------------------------------------------------------
+
+int main(int argc, char *argv[]) {
+    int failed_tests = 0;
+    bool found = argc < 2;
+    for (const auto &test: TESTS) {
+        if (argc >= 2 && std::strcmp(argv[1], test.name) != 0) continue;
+        found = true;
+        failures = 0;
+        test.run();
+        std::cout << test.name << ": " << (failures == 0 ? "passed" : "FAILED") << "\n";
+        if (failures != 0) ++failed_tests;
+    }
+    if (!found) {
+        std::cerr << "usage: " << argv[0] << " [one-pass|parallel|cache|linker|incbin|listing|images|diagnostics|simulator]\n";
+        return 1;
+    }
+    return failed_tests == 0 ? 0 : 1;
+}
@@ -0,0 +1,18 @@
+# lines that the lexer has to take apart like the regex lexer did
+start:add $t0, $t1,$t2
+	addi	$t0,	$t0,	-1	# tabs everywhere
+  sub $t3, $t4,$t5   #   a comment # with two hashes
+x1: y1: nop
+lw $t6, -8($sp)
+sw $t7, 0($gp)     
+beq $t0, $zero,start
+sll $s0, $s1, 31
+j x1
+single:
+jr $ra#comment without blank
+   # indented comment
+
+nop  
+or $a0, $v0, $v1
+last:   slt $k0, $k1,$fp # end
+    